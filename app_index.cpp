@@ -0,0 +1,278 @@
+#include "app_index.hpp"
+#include <sys/stat.h>
+#include <dirent.h>
+#include <strings.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_set>
+#include "util.hpp"
+#include "trace.hpp"
+
+using namespace std;
+
+namespace {
+
+// An application as read from its .desktop file
+struct DesktopEntry {
+    string name, exec, categories, icon;
+};
+
+string Trim(const string& s) {
+    size_t begin = s.find_first_not_of(" \t\r\n");
+    if(begin == string::npos)
+        return string();
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(begin, end - begin + 1);
+}
+
+// Remove the %f, %U, ... field codes from an Exec value. We never pass files, so they all go away
+string StripFieldCodes(const string& exec) {
+    string out;
+    for(size_t i = 0; i < exec.size(); ++i) {
+        if(exec[i] != '%') {
+            out += exec[i];
+        } else if(i + 1 < exec.size()) {
+            if(exec[i + 1] == '%')
+                out += '%';
+            ++i;
+        }
+    }
+    return Trim(out);
+}
+
+// Read the [Desktop Entry] group of a .desktop file. Returns false for anything that shouldn't be in the menu
+bool ParseDesktopFile(const string& path, DesktopEntry& entry) {
+    FILE *file = fopen(path.c_str(), "r");
+    if(!file)
+        return false;
+
+    bool in_entry = false, application = false, hidden = false;
+    char *line = nullptr;
+    size_t capacity = 0;
+    ssize_t length;
+    while((length = getline(&line, &capacity, file)) >= 0) {
+        string text = Trim(string(line, length));
+        if(text.empty() || text[0] == '#')
+            continue;
+        if(text[0] == '[') {
+            // Other groups (actions) come after the main one
+            if(in_entry)
+                break;
+            in_entry = text == "[Desktop Entry]";
+            continue;
+        }
+        if(!in_entry)
+            continue;
+
+        size_t equals = text.find('=');
+        if(equals == string::npos)
+            continue;
+        // Localized keys like Name[de] don't match and are skipped
+        const string key = Trim(text.substr(0, equals));
+        const string value = Trim(text.substr(equals + 1));
+        if(key == "Name") {
+            entry.name = value;
+        } else if(key == "Exec") {
+            entry.exec = StripFieldCodes(value);
+        } else if(key == "Categories") {
+            entry.categories = value;
+        } else if(key == "Icon") {
+            entry.icon = value;
+        } else if(key == "Type") {
+            application = value == "Application";
+        } else if(key == "NoDisplay" || key == "Hidden") {
+            hidden = hidden || value == "true";
+        }
+    }
+    free(line);
+    fclose(file);
+    return application && !hidden && !entry.name.empty() && !entry.exec.empty();
+}
+
+}
+
+AppIndex::~AppIndex() {
+    Unmap();
+}
+
+void AppIndex::Unmap() {
+    file_.Close();
+    memory_.clear();
+    dirs_ = nullptr;
+    entries_ = nullptr;
+    strings_ = nullptr;
+    dir_count_ = entry_count_ = 0;
+}
+
+vector<AppIndex::DirState> AppIndex::Directories() {
+    vector<string> roots;
+    const char *data_home = getenv("XDG_DATA_HOME");
+    const char *home = getenv("HOME");
+    if(data_home && *data_home) {
+        roots.push_back(data_home);
+    } else if(home) {
+        roots.push_back(string(home) + "/.local/share");
+    }
+    const char *data_dirs = getenv("XDG_DATA_DIRS");
+    string dirs = data_dirs && *data_dirs ? data_dirs : "/usr/local/share:/usr/share";
+    size_t start = 0;
+    while(start <= dirs.size()) {
+        size_t end = dirs.find(':', start);
+        if(end == string::npos)
+            end = dirs.size();
+        if(end > start)
+            roots.push_back(dirs.substr(start, end - start));
+        start = end + 1;
+    }
+
+    vector<DirState> states;
+    for(const string& root : roots) {
+        DirState state;
+        state.path = root + "/applications";
+        struct stat st;
+        if(stat(state.path.c_str(), &st) == 0) {
+            state.mtime_sec = st.st_mtim.tv_sec;
+            state.mtime_nsec = st.st_mtim.tv_nsec;
+        } else {
+            state.mtime_sec = state.mtime_nsec = -1;
+        }
+        states.push_back(state);
+    }
+    return states;
+}
+
+bool AppIndex::Use(const uint8_t *data, size_t length, const vector<DirState>& dirs) {
+    if(length < sizeof(AppIndexHeader))
+        return false;
+    const AppIndexHeader *header = reinterpret_cast<const AppIndexHeader*>(data);
+    if(memcmp(header->magic, APP_INDEX_MAGIC, sizeof(header->magic)) != 0)
+        return false;
+    const size_t dirs_offset = sizeof(AppIndexHeader);
+    const size_t entries_offset = dirs_offset + size_t(header->dir_count)*sizeof(AppIndexDir);
+    const size_t strings_offset = entries_offset + size_t(header->entry_count)*sizeof(AppIndexEntry);
+    if(strings_offset + header->strings_size != length || header->strings_size == 0)
+        return false;
+
+    // Every string ends before the end of the table, so any offset inside it is safe to read
+    const uint32_t strings_size = header->strings_size;
+    const char *strings = reinterpret_cast<const char*>(data + strings_offset);
+    if(strings[strings_size - 1] != '\0')
+        return false;
+
+    // Stale if the directories, or anything in them, changed since the index was built
+    const AppIndexDir *index_dirs = reinterpret_cast<const AppIndexDir*>(data + dirs_offset);
+    if(header->dir_count != dirs.size())
+        return false;
+    for(size_t i = 0; i < dirs.size(); ++i) {
+        if(index_dirs[i].path >= strings_size || dirs[i].path != strings + index_dirs[i].path
+                || index_dirs[i].mtime_sec != dirs[i].mtime_sec || index_dirs[i].mtime_nsec != dirs[i].mtime_nsec)
+            return false;
+    }
+
+    const AppIndexEntry *entries = reinterpret_cast<const AppIndexEntry*>(data + entries_offset);
+    for(size_t i = 0; i < header->entry_count; ++i) {
+        if(entries[i].name >= strings_size || entries[i].exec >= strings_size
+                || entries[i].categories >= strings_size || entries[i].icon >= strings_size)
+            return false;
+    }
+
+    dirs_ = index_dirs;
+    dir_count_ = header->dir_count;
+    entries_ = entries;
+    entry_count_ = header->entry_count;
+    strings_ = strings;
+    return true;
+}
+
+vector<uint8_t> AppIndex::Build(const vector<DirState>& dirs) {
+    TRACE_SPAN("BuildAppIndex");
+    // The first directory with a given file name wins, so the user's own entries override the system ones
+    vector<DesktopEntry> apps;
+    unordered_set<string> seen;
+    for(const DirState& dir : dirs) {
+        DIR *handle = opendir(dir.path.c_str());
+        if(!handle)
+            continue;
+        while(dirent *ent = readdir(handle)) {
+            const size_t length = strlen(ent->d_name);
+            if(length <= 8 || strcmp(ent->d_name + length - 8, ".desktop") != 0)
+                continue;
+            if(!seen.insert(ent->d_name).second)
+                continue;
+            DesktopEntry entry;
+            if(ParseDesktopFile(dir.path + "/" + ent->d_name, entry))
+                apps.push_back(move(entry));
+        }
+        closedir(handle);
+    }
+    sort(apps.begin(), apps.end(), [](const DesktopEntry& a, const DesktopEntry& b) {
+        return strcasecmp(a.name.c_str(), b.name.c_str()) < 0;
+    });
+
+    // Offset 0 is the empty string
+    string strings(1, '\0');
+    auto add = [&strings](const string& s) -> uint32_t {
+        if(s.empty())
+            return 0;
+        uint32_t offset = strings.size();
+        strings.append(s.c_str(), s.size() + 1);
+        return offset;
+    };
+
+    vector<AppIndexDir> index_dirs;
+    for(const DirState& dir : dirs) {
+        index_dirs.push_back(AppIndexDir{ add(dir.path), 0, dir.mtime_sec, dir.mtime_nsec });
+    }
+    vector<AppIndexEntry> entries;
+    for(const DesktopEntry& app : apps) {
+        entries.push_back(AppIndexEntry{ add(app.name), add(app.exec), add(app.categories), add(app.icon) });
+    }
+
+    AppIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, APP_INDEX_MAGIC, sizeof(header.magic));
+    header.dir_count = index_dirs.size();
+    header.entry_count = entries.size();
+    header.strings_size = strings.size();
+
+    vector<uint8_t> image;
+    auto append = [&image](const void *data, size_t length) {
+        const uint8_t *bytes = static_cast<const uint8_t*>(data);
+        image.insert(image.end(), bytes, bytes + length);
+    };
+    append(&header, sizeof(header));
+    append(index_dirs.data(), index_dirs.size()*sizeof(AppIndexDir));
+    append(entries.data(), entries.size()*sizeof(AppIndexEntry));
+    append(strings.data(), strings.size());
+    return image;
+}
+
+bool AppIndex::Refresh() {
+    TRACE_SPAN("RefreshAppIndex");
+    const vector<DirState> dirs = Directories();
+    const uint8_t *current = file_.data ? file_.data : memory_.data();
+    const size_t current_length = file_.data ? file_.length : memory_.size();
+    if(strings_ && Use(current, current_length, dirs))
+        return false;
+    Unmap();
+
+    // Load the index a previous run left behind
+    const string cache_dir = CacheDirectory();
+    const string path = cache_dir + "/" APP_INDEX_FILE;
+    if(!cache_dir.empty() && file_.Open(path) && Use(file_.data, file_.length, dirs))
+        return true;
+    Unmap();
+
+    // Out of date or missing, so parse the .desktop files again
+    memory_ = Build(dirs);
+    Use(memory_.data(), memory_.size(), dirs);
+
+    // Written under a temporary name and renamed, so readers never see half an index
+    if(!cache_dir.empty()) {
+        RemoveStaleTempFiles(cache_dir);
+        WriteFileAtomic(path, { { memory_.data(), memory_.size() } });
+    }
+    return true;
+}
@@ -0,0 +1,89 @@
+#ifndef APP_INDEX_HPP
+#define APP_INDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "util.hpp"
+
+// Identifies an application index file, followed by the version of its layout
+#define APP_INDEX_MAGIC "LXPAPPS1"
+
+// File name of the index in CacheDirectory()
+#define APP_INDEX_FILE "apps.idx"
+
+// Layout of the index file, in native byte order:
+//   AppIndexHeader
+//   AppIndexDir[dir_count]      the directories it was built from, with their mtimes
+//   AppIndexEntry[entry_count]  sorted by name
+//   char[strings_size]          NUL-terminated strings, referenced by offset
+struct AppIndexHeader {
+    char magic[8];
+    uint32_t dir_count, entry_count, strings_size;
+    uint32_t reserved;
+};
+
+struct AppIndexDir {
+    uint32_t path;
+    uint32_t reserved;
+    // -1 if the directory didn't exist
+    int64_t mtime_sec, mtime_nsec;
+};
+
+// One application. Exec already has its % field codes removed, so it can be passed to sh -c
+struct AppIndexEntry {
+    uint32_t name, exec, categories, icon;
+};
+
+// Installed applications, from the .desktop files in the XDG applications directories.
+// The files are parsed once into a compact binary index that is cached on disk and mmapped, and only
+// parsed again when the mtime of one of the directories changes, i.e. when an entry is added or removed
+class AppIndex {
+    public:
+        AppIndex() = default;
+        AppIndex(const AppIndex&) = delete;
+        AppIndex& operator=(const AppIndex&) = delete;
+        ~AppIndex();
+
+        // Make sure the index matches the directories, loading or rebuilding it if needed.
+        // Only stats the directories if it is already up to date. Returns whether the entries changed
+        bool Refresh();
+
+        size_t size() const { return entry_count_; }
+
+        const char *Name(size_t i) const { return strings_ + entries_[i].name; }
+        const char *Exec(size_t i) const { return strings_ + entries_[i].exec; }
+        const char *Categories(size_t i) const { return strings_ + entries_[i].categories; }
+        const char *Icon(size_t i) const { return strings_ + entries_[i].icon; }
+
+    private:
+        // A directory and its current mtime
+        struct DirState {
+            ::std::string path;
+            int64_t mtime_sec, mtime_nsec;
+        };
+
+        // $XDG_DATA_HOME/applications, then the applications directory of each of $XDG_DATA_DIRS
+        static ::std::vector<DirState> Directories();
+
+        // Point the accessors at an index image if it is well formed and built from dirs
+        bool Use(const uint8_t *data, size_t length, const ::std::vector<DirState>& dirs);
+
+        // Parse the .desktop files into an index image
+        static ::std::vector<uint8_t> Build(const ::std::vector<DirState>& dirs);
+
+        void Unmap();
+
+        // Either an mmapped index file, or a freshly built image in memory_ if it couldn't be written
+        MappedFile file_;
+        ::std::vector<uint8_t> memory_;
+
+        const AppIndexDir *dirs_ = nullptr;
+        uint32_t dir_count_ = 0;
+        const AppIndexEntry *entries_ = nullptr;
+        uint32_t entry_count_ = 0;
+        const char *strings_ = nullptr;
+};
+
+#endif
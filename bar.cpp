@@ -8,21 +8,15 @@ extern "C" {
 #include <cstdio>
 #include <iostream>
 
-void Bar::Create(Display *display, Window root) {
+void Bar::Create(Display *display, Window root, const Rect<int>& output_rect) {
 
-    Window returned_root;
-    int x_root, y_root;
-    unsigned width_root, height_root, border_width_root, depth_root;
-    XGetGeometry(display, root, &returned_root, &x_root, &y_root, &width_root, &height_root, &border_width_root, &depth_root);
+    bar_win.reset(display, XCreateSimpleWindow(display, root, output_rect.x, output_rect.y+output_rect.height-BAR_HEIGHT, output_rect.width, BAR_HEIGHT, BAR_BORDER_WIDTH, BAR_BORDER_COLOR, BAR_COLOR));
 
+    start_button.reset(display, XCreateSimpleWindow(display, bar_win, 0, 0, 99, 31, 0, 0xffffff, 0xffffff));
 
-    bar_win = XCreateSimpleWindow(display, root, 0, height_root-BAR_HEIGHT, width_root, BAR_HEIGHT, BAR_BORDER_WIDTH, BAR_BORDER_COLOR, BAR_COLOR);
-
-    start_button = XCreateSimpleWindow(display, bar_win, 0, 0, 99, 31, 0, 0xffffff, 0xffffff);
-
-    start_pix = LoadImage("start_button.bmp", display, root);
-    start_pix_hover = LoadImage("start_button_hover.bmp", display, root);
-    start_pix_press = LoadImage("start_button_pressed.bmp", display, root);
+    start_pix.reset(display, LoadImage("start_button.bmp", display, root));
+    start_pix_hover.reset(display, LoadImage("start_button_hover.bmp", display, root));
+    start_pix_press.reset(display, LoadImage("start_button_pressed.bmp", display, root));
     XSetWindowBackgroundPixmap(display, start_button, start_pix);
 
     XMapWindow(display, start_button);
@@ -30,3 +24,22 @@ void Bar::Create(Display *display, Window root) {
 
     XMapWindow(display, bar_win);
 }
+
+void Bar::Move(Display *display, const Rect<int>& output_rect) {
+    XMoveResizeWindow(display, bar_win, output_rect.x, output_rect.y+output_rect.height-BAR_HEIGHT, output_rect.width, BAR_HEIGHT);
+}
+
+void Bar::SetPressed(Display *display, bool pressed) {
+    XSetWindowBackgroundPixmap(display, start_button, pressed ? start_pix_press : start_pix);
+    XClearWindow(display, start_button);
+}
+
+ResourceCounts Bar::Resources() const {
+    ResourceCounts counts;
+    bar_win.Count(counts);
+    start_button.Count(counts);
+    start_pix.Count(counts);
+    start_pix_press.Count(counts);
+    start_pix_hover.Count(counts);
+    return counts;
+}
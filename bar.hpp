@@ -7,6 +7,7 @@ extern "C" {
 #include <memory>
 #include <unordered_map>
 #include "util.hpp"
+#include "resource.hpp"
 
 #define BAR_HEIGHT 31
 #define BAR_COLOR 0x0000ff
@@ -15,14 +16,24 @@ extern "C" {
 
 class Bar {
     public:
-        void Create(Display *display, Window root);
+        // Create a bar along the bottom edge of output_rect
+        void Create(Display *display, Window root, const Rect<int>& output_rect);
 
+        // Move the bar to the bottom edge of output_rect
+        void Move(Display *display, const Rect<int>& output_rect);
 
-        Window bar_win;
+        // Show the start button pressed while the start menu is open
+        void SetPressed(Display *display, bool pressed);
 
-        Window start_button;
+        // Server resources owned by this bar
+        ResourceCounts Resources() const;
 
-        Pixmap start_pix, start_pix_press, start_pix_hover;
+        // Declared first so it is destroyed after start_button
+        OwnedWindow bar_win;
+
+        OwnedWindow start_button;
+
+        OwnedPixmap start_pix, start_pix_press, start_pix_hover;
 
     private:
 
@@ -0,0 +1,251 @@
+// Resource churn test. Maps and unmaps many client windows with titles and icons against a running WM
+// and checks with the X-Resource extension that the resources the server holds for the WM's client
+// don't grow. Run it with churn_test.sh, which starts the WM under Xvfb
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/extensions/XRes.h>
+}
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ipc.hpp"
+
+using namespace std;
+
+// Windows mapped in total, and how many are mapped at once
+#define CHURN_WINDOWS 10000
+#define CHURN_BATCH 100
+
+// How long to wait for the WM to catch up with one batch
+#define CHURN_TIMEOUT_MS 10000
+
+// How long the WM gets to finish background work before its resources are measured
+#define CHURN_SETTLE_MS 500
+
+static bool WriteAll(int fd, const void *data, size_t size) {
+    const char *p = static_cast<const char*>(data);
+    while(size > 0) {
+        ssize_t n = write(fd, p, size);
+        if(n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool ReadAll(int fd, void *data, size_t size) {
+    char *p = static_cast<char*>(data);
+    while(size > 0) {
+        ssize_t n = read(fd, p, size);
+        if(n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Sends a request without payload and returns the reply's payload
+static bool Request(int fd, uint32_t type, string& reply) {
+    IpcHeader header = { 0, type };
+    if(!WriteAll(fd, &header, sizeof(header)) || !ReadAll(fd, &header, sizeof(header)) || header.type != type)
+        return false;
+    reply.resize(header.length);
+    return ReadAll(fd, &reply[0], header.length);
+}
+
+// Waits until the WM manages exactly count windows
+static bool WaitForTree(int fd, size_t count) {
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(CHURN_TIMEOUT_MS);
+    string reply;
+    while(Request(fd, IPC_GET_TREE, reply)) {
+        if(reply.size() / sizeof(IpcWindowInfo) == count)
+            return true;
+        if(chrono::steady_clock::now() > deadline)
+            break;
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    fprintf(stderr, "WM manages %zu windows, expected %zu\n", reply.size() / sizeof(IpcWindowInfo), count);
+    return false;
+}
+
+// What the X server holds for one client: the count of each resource type and the bytes of its pixmaps
+struct ServerResources {
+    map<Atom, unsigned int> counts;
+    unsigned long pixmap_bytes = 0;
+};
+
+// Resource id of any window the WM created, which identifies its client to XRes
+static Window WmWindow(Display *display) {
+    Atom type;
+    int format;
+    unsigned long count, bytes_after;
+    unsigned char *data = nullptr;
+    Window w = None;
+    if(XGetWindowProperty(display, DefaultRootWindow(display), XInternAtom(display, "_NET_SUPPORTING_WM_CHECK", false),
+                0, 1, false, XA_WINDOW, &type, &format, &count, &bytes_after, &data) == Success && data) {
+        if(type == XA_WINDOW && format == 32 && count == 1)
+            w = *reinterpret_cast<Window*>(data);
+        XFree(data);
+    }
+    return w;
+}
+
+static bool QueryServer(Display *display, XID wm_window, ServerResources& resources) {
+    int type_count = 0;
+    XResType *types = nullptr;
+    if(!XResQueryClientResources(display, wm_window, &type_count, &types))
+        return false;
+    resources.counts.clear();
+    for(int i = 0; i < type_count; ++i) {
+        resources.counts[types[i].resource_type] = types[i].count;
+    }
+    XFree(types);
+    return XResQueryClientPixmapBytes(display, wm_window, &resources.pixmap_bytes);
+}
+
+// Prints every resource type that grew, returns whether one did
+static bool ReportGrowth(Display *display, const ServerResources& before, const ServerResources& after) {
+    bool grew = false;
+    for(const auto& type : after.counts) {
+        auto it = before.counts.find(type.first);
+        const unsigned int count_before = it == before.counts.end() ? 0 : it->second;
+        char *name = XGetAtomName(display, type.first);
+        printf("%-16s %6u -> %6u\n", name ? name : "?", count_before, type.second);
+        if(name)
+            XFree(name);
+        grew = grew || type.second > count_before;
+    }
+    printf("%-16s %6lu -> %6lu\n", "pixmap bytes", before.pixmap_bytes, after.pixmap_bytes);
+    return grew || after.pixmap_bytes > before.pixmap_bytes;
+}
+
+// Titles and icons go through the WM's title pixmap, glyph and icon paths
+static void SetTitle(Display *display, Window w, const string& title) {
+    XStoreName(display, w, title.c_str());
+    XChangeProperty(display, w, XInternAtom(display, "_NET_WM_NAME", false), XInternAtom(display, "UTF8_STRING", false), 8,
+            PropModeReplace, reinterpret_cast<const unsigned char*>(title.data()), title.size());
+}
+
+static void SetIcon(Display *display, Window w, int size, unsigned long color) {
+    // Format 32 properties are passed as longs
+    vector<unsigned long> icon(2 + size*size, 0xff000000 | color);
+    icon[0] = icon[1] = size;
+    XChangeProperty(display, w, XInternAtom(display, "_NET_WM_ICON", false), XA_CARDINAL, 32, PropModeReplace,
+            reinterpret_cast<const unsigned char*>(icon.data()), icon.size());
+}
+
+// Maps a batch of windows with titles and icons, changes both while the WM manages them, then unmaps
+// and destroys them. Returns false if the WM doesn't keep up
+static bool Churn(Display *display, int fd, size_t baseline, int batch) {
+    const Window root = DefaultRootWindow(display);
+    vector<Window> windows(CHURN_BATCH);
+    for(size_t i = 0; i < windows.size(); ++i) {
+        windows[i] = XCreateSimpleWindow(display, root, 0, 0, 100 + i % 50, 80 + i % 30, 0, 0, 0);
+        SetTitle(display, windows[i], "churn " + to_string(batch) + "/" + to_string(i));
+        SetIcon(display, windows[i], 16 + i % 3*16, 0x3080c0);
+        XMapWindow(display, windows[i]);
+    }
+    XSync(display, false);
+    if(!WaitForTree(fd, baseline + windows.size()))
+        return false;
+
+    for(size_t i = 0; i < windows.size(); ++i) {
+        SetTitle(display, windows[i], "renamed churn window " + to_string(batch) + "/" + to_string(i));
+        SetIcon(display, windows[i], 32, 0xc08030);
+    }
+    XSync(display, false);
+    // One more round trip through the WM, so it has seen the property changes
+    if(!WaitForTree(fd, baseline + windows.size()))
+        return false;
+
+    for(Window w : windows) {
+        XUnmapWindow(display, w);
+        XDestroyWindow(display, w);
+    }
+    XSync(display, false);
+    return WaitForTree(fd, baseline);
+}
+
+int main() {
+    Display *display = XOpenDisplay(nullptr);
+    if(!display) {
+        fprintf(stderr, "Failed to open X display\n");
+        return 1;
+    }
+    int event_base, error_base;
+    if(!XResQueryExtension(display, &event_base, &error_base)) {
+        fprintf(stderr, "The X server has no X-Resource extension\n");
+        return 1;
+    }
+    const Window wm_window = WmWindow(display);
+    if(wm_window == None) {
+        fprintf(stderr, "No window manager is running\n");
+        return 1;
+    }
+
+    const char *socket_path = getenv("LINUXXP_SOCKET");
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(!socket_path || strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "LINUXXP_SOCKET is not set\n");
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        perror("connect");
+        return 1;
+    }
+
+    string tree;
+    if(!Request(fd, IPC_GET_TREE, tree)) {
+        fprintf(stderr, "No reply from the WM\n");
+        return 1;
+    }
+    const size_t baseline = tree.size() / sizeof(IpcWindowInfo);
+
+    // One batch first, so what the WM only creates once (glyphs, cached shapes) is in the baseline
+    ServerResources before, after;
+    if(!Churn(display, fd, baseline, -1))
+        return 1;
+    this_thread::sleep_for(chrono::milliseconds(CHURN_SETTLE_MS));
+    if(!QueryServer(display, wm_window, before)) {
+        fprintf(stderr, "XRes query failed\n");
+        return 1;
+    }
+
+    for(int done = 0; done < CHURN_WINDOWS; done += CHURN_BATCH) {
+        if(!Churn(display, fd, baseline, done / CHURN_BATCH))
+            return 1;
+    }
+
+    // Icons are loaded by worker threads, give the last results time to be applied and dropped
+    this_thread::sleep_for(chrono::milliseconds(CHURN_SETTLE_MS));
+    if(!Request(fd, IPC_GET_TREE, tree) || !QueryServer(display, wm_window, after)) {
+        fprintf(stderr, "No reply from the WM\n");
+        return 1;
+    }
+
+    const bool leaked = ReportGrowth(display, before, after);
+    close(fd);
+    XCloseDisplay(display);
+
+    if(leaked) {
+        fprintf(stderr, "FAIL: the WM's X resources grew over %d windows\n", CHURN_WINDOWS);
+        return 1;
+    }
+    printf("No resources leaked over %d windows\n", CHURN_WINDOWS);
+    return 0;
+}
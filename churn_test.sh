@@ -0,0 +1,36 @@
+#!/bin/bash
+# Runs the WM under Xvfb and checks with churn_test that mapping and unmapping many windows
+# doesn't leak X resources
+
+set -e
+
+DISPLAY_NUMBER=:99
+RUNTIME_DIR=$(mktemp -d)
+
+cleanup() {
+    kill $WM_PID $XVFB_PID 2>/dev/null || true
+    wait 2>/dev/null || true
+    rm -rf "$RUNTIME_DIR"
+}
+trap cleanup EXIT
+
+Xvfb $DISPLAY_NUMBER -screen 0 1920x1080x24 -nolisten tcp &
+XVFB_PID=$!
+
+export DISPLAY=$DISPLAY_NUMBER
+export XDG_RUNTIME_DIR=$RUNTIME_DIR
+export LINUXXP_SOCKET=$RUNTIME_DIR/linuxxp-$DISPLAY_NUMBER.sock
+
+# Wait for the server, then for the WM's control socket
+for i in $(seq 50); do
+    [ -S /tmp/.X11-unix/X${DISPLAY_NUMBER#:} ] && break
+    sleep 0.1
+done
+./window_manager.o &
+WM_PID=$!
+for i in $(seq 50); do
+    [ -S "$LINUXXP_SOCKET" ] && break
+    sleep 0.1
+done
+
+./churn_test.o
@@ -0,0 +1,107 @@
+#include "font.hpp"
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xft/Xft.h>
+}
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+bool GlyphCache::Open(Display *display, const char *pattern) {
+    int screen_num = DefaultScreen(display);
+    font = XftFontOpenName(display, screen_num, pattern);
+    if(!font)
+        font = XftFontOpenName(display, screen_num, TITLE_FONT_FALLBACK);
+    if(!font) {
+        fprintf(stderr, "Cannot load font: %s\n", pattern);
+        return false;
+    }
+
+    XftColorAllocName(display, DefaultVisual(display, screen_num), DefaultColormap(display, screen_num), TITLE_COLOR, &color_);
+
+    for(int& advance : ascii_advance_)
+        advance = -1;
+    advance_.clear();
+    return true;
+}
+
+void GlyphCache::Close(Display *display) {
+    if(!font)
+        return;
+    int screen_num = DefaultScreen(display);
+    XftColorFree(display, DefaultVisual(display, screen_num), DefaultColormap(display, screen_num), &color_);
+    XftFontClose(display, font);
+    font = nullptr;
+}
+
+int GlyphCache::Advance(Display *display, FcChar32 c) {
+    if(c < 128 && ascii_advance_[c] >= 0)
+        return ascii_advance_[c];
+    if(c >= 128) {
+        auto it = advance_.find(c);
+        if(it != advance_.end())
+            return it->second;
+    }
+
+    XGlyphInfo extents;
+    XftTextExtents32(display, font, &c, 1, &extents);
+    if(c < 128)
+        ascii_advance_[c] = extents.xOff;
+    else
+        advance_[c] = extents.xOff;
+    return extents.xOff;
+}
+
+FittedText GlyphCache::Fit(Display *display, const string& text, int max_width) {
+    // Width of the text up to each code point boundary
+    vector<size_t> offsets;
+    vector<int> widths;
+    int width = 0;
+    const FcChar8 *data = reinterpret_cast<const FcChar8*>(text.data());
+    size_t pos = 0;
+    while(pos < text.size()) {
+        FcChar32 c;
+        int length = FcUtf8ToUcs4(data + pos, &c, text.size() - pos);
+        if(length <= 0)
+            break;
+        offsets.push_back(pos);
+        widths.push_back(width);
+        width += Advance(display, c);
+        pos += length;
+    }
+    offsets.push_back(pos);
+    widths.push_back(width);
+
+    FittedText fitted;
+    if(width <= max_width) {
+        fitted.text = text.substr(0, pos);
+        fitted.width = width;
+        fitted.min_width = width;
+        fitted.max_width = INT_MAX;
+        return fitted;
+    }
+
+    // Longest prefix that still has room for the ellipsis
+    const int ellipsis = 3*Advance(display, '.');
+    size_t count = 0;
+    while(count + 1 < widths.size() && widths[count + 1] + ellipsis <= max_width)
+        ++count;
+
+    fitted.text = text.substr(0, offsets[count]) + "...";
+    fitted.width = widths[count] + ellipsis;
+    fitted.min_width = count == 0 ? INT_MIN : fitted.width;
+    fitted.max_width = min(widths[count + 1] + ellipsis, width);
+    return fitted;
+}
+
+void GlyphCache::Draw(Display *display, Drawable drawable, const string& text, int x, int y, int height) {
+    int screen_num = DefaultScreen(display);
+    XftDraw *draw = XftDrawCreate(display, drawable, DefaultVisual(display, screen_num), DefaultColormap(display, screen_num));
+    int baseline = y + (height - (font->ascent + font->descent))/2 + font->ascent;
+    XftDrawStringUtf8(draw, &color_, font, x, baseline, reinterpret_cast<const FcChar8*>(text.data()), text.size());
+    XftDrawDestroy(draw);
+}
@@ -0,0 +1,58 @@
+#ifndef FONT_HPP
+#define FONT_HPP
+
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xft/Xft.h>
+}
+#include <string>
+#include <unordered_map>
+
+#define TITLE_FONT "Tahoma:bold:size=8"
+#define TITLE_FONT_FALLBACK "sans:bold:size=8"
+#define TITLE_COLOR "white"
+
+// Text that was fitted into a width
+struct FittedText {
+    // Text to draw, with "..." at the end if it was truncated
+    ::std::string text;
+
+    // Width of text in pixels
+    int width;
+
+    // Range of widths [min_width, max_width) for which fitting gives the same text
+    int min_width, max_width;
+};
+
+// One font shared by all titlebars, together with a cache of glyph advances so fitting a
+// title into a width never needs to ask Xft again for a glyph that has been seen before
+class GlyphCache {
+    public:
+        // Open the font. Returns false if neither TITLE_FONT nor the fallback could be loaded
+        bool Open(Display *display, const char *pattern);
+
+        // Close the font
+        void Close(Display *display);
+
+        // Horizontal advance of a code point
+        int Advance(Display *display, FcChar32 c);
+
+        // Longest prefix of the UTF-8 text that fits in max_width, truncated with "..."
+        FittedText Fit(Display *display, const ::std::string& text, int max_width);
+
+        // Draw text in TITLE_COLOR with its left edge at x, vertically centered in the band [y, y+height)
+        void Draw(Display *display, Drawable drawable, const ::std::string& text, int x, int y, int height);
+
+        XftFont *font = nullptr;
+
+    private:
+        XftColor color_;
+
+        // Advances of ASCII code points, -1 if not known yet
+        int ascii_advance_[128];
+
+        // Advances of everything else
+        ::std::unordered_map<FcChar32, int> advance_;
+};
+
+#endif
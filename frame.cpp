@@ -3,23 +3,40 @@
 #include <Imlib2.h>
 extern "C" {
 #include <X11/Xlib.h>
+#include <X11/Xutil.h>
 }
 #include "util.hpp"
 #include "image.hpp"
+#include "icon.hpp"
+#include "shape.hpp"
 #include <cstdio>
 #include <iostream>
 
 using namespace std;
 
+// Left edge of the title, after the icon
+#define TITLE_X (BUTTON_PADDING+ICON_SIZE+BUTTON_PADDING)
+
 Frame::~Frame() {
 
 }
 
-void Frame::Create(Display *display, Window root, Window win_to_frame, XWindowAttributes attrs) {
+void FrameTheme::Load(Display *display, Window root) {
+    close_pix.reset(display, LoadImage("close.bmp", display, root));
+    max_pix.reset(display, LoadImage("maximize.bmp", display, root));
+    min_pix.reset(display, LoadImage("minimize.bmp", display, root));
+    rounded = CornerShape::Supported(display);
+}
+
+void Frame::Create(Display *display, Window root, Window win_to_frame, XWindowAttributes attrs, const FrameTheme& theme) {
 
     // Save client window
     client_win = win_to_frame;
 
+    // Save frame geometry
+    position = Position<int>(attrs.x, attrs.y);
+    size = Size<int>(attrs.width + CLIENT_OFFSET_X, attrs.height + CLIENT_OFFSET_Y+BUTTON_PADDING*2);
+
     // Screen number
     int screen_num = DefaultScreen(display);
 
@@ -29,22 +46,35 @@ void Frame::Create(Display *display, Window root, Window win_to_frame, XWindowAt
     frame_attr.border_pixel = FRAME_BORDER_COLOR;
     frame_attr.background_pixel = FRAME_BG_COLOR;
     frame_attr.event_mask = ExposureMask | SubstructureNotifyMask | ButtonPressMask;
-    frame_win = XCreateWindow(display, root, attrs.x, attrs.y, attrs.width + CLIENT_OFFSET_X, attrs.height + CLIENT_OFFSET_Y+BUTTON_PADDING*2, FRAME_BORDER_WIDTH,
-            DefaultDepth(display, screen_num), InputOutput, DefaultVisual(display, screen_num), valuemask, &frame_attr);
+    frame_win.reset(display, XCreateWindow(display, root, position.x, position.y, size.width, size.height, FRAME_BORDER_WIDTH,
+            DefaultDepth(display, screen_num), InputOutput, DefaultVisual(display, screen_num), valuemask, &frame_attr));
     printf("%d, %d\n", attrs.width, attrs.height);
 
-    XSelectInput(display, frame_win, ExposureMask | SubstructureNotifyMask);
+    XSelectInput(display, frame_win, FRAME_EVENT_MASK);
 
     // Close button
-    close_win = XCreateSimpleWindow(display, frame_win, attrs.x+attrs.width-BUTTON_SIZE-2*BUTTON_BORDER_WIDTH-BUTTON_PADDING, attrs.y+BUTTON_PADDING, BUTTON_SIZE, BUTTON_SIZE, BUTTON_BORDER_WIDTH, BUTTON_BORDER_COLOR, BUTTON_BG_COLOR_R);
+    close_win.reset(display, XCreateSimpleWindow(display, frame_win, attrs.x+attrs.width-BUTTON_SIZE-2*BUTTON_BORDER_WIDTH-BUTTON_PADDING, attrs.y+BUTTON_PADDING, BUTTON_SIZE, BUTTON_SIZE, BUTTON_BORDER_WIDTH, BUTTON_BORDER_COLOR, BUTTON_BG_COLOR_R));
 
-    max_win = XCreateSimpleWindow(display, frame_win, attrs.x+attrs.width-2*BUTTON_SIZE-4*BUTTON_BORDER_WIDTH-DISTANCE_BETWEEN_BUTTONS-BUTTON_PADDING, attrs.y+BUTTON_PADDING, BUTTON_SIZE, BUTTON_SIZE, BUTTON_BORDER_WIDTH, BUTTON_BORDER_COLOR, BUTTON_BG_COLOR_B);
+    max_win.reset(display, XCreateSimpleWindow(display, frame_win, attrs.x+attrs.width-2*BUTTON_SIZE-4*BUTTON_BORDER_WIDTH-DISTANCE_BETWEEN_BUTTONS-BUTTON_PADDING, attrs.y+BUTTON_PADDING, BUTTON_SIZE, BUTTON_SIZE, BUTTON_BORDER_WIDTH, BUTTON_BORDER_COLOR, BUTTON_BG_COLOR_B));
 
-    min_win = XCreateSimpleWindow(display, frame_win, attrs.x+attrs.width-3*BUTTON_SIZE-6*BUTTON_BORDER_WIDTH-2*DISTANCE_BETWEEN_BUTTONS-BUTTON_PADDING, attrs.y+BUTTON_PADDING, BUTTON_SIZE, BUTTON_SIZE, BUTTON_BORDER_WIDTH, BUTTON_BORDER_COLOR, BUTTON_BG_COLOR_B);
+    min_win.reset(display, XCreateSimpleWindow(display, frame_win, attrs.x+attrs.width-3*BUTTON_SIZE-6*BUTTON_BORDER_WIDTH-2*DISTANCE_BETWEEN_BUTTONS-BUTTON_PADDING, attrs.y+BUTTON_PADDING, BUTTON_SIZE, BUTTON_SIZE, BUTTON_BORDER_WIDTH, BUTTON_BORDER_COLOR, BUTTON_BG_COLOR_B));
+
+    // Icon, shown once it has been loaded
+    icon_win.reset(display, XCreateSimpleWindow(display, frame_win, BUTTON_PADDING, BUTTON_PADDING+(BUTTON_SIZE-ICON_SIZE)/2, ICON_SIZE, ICON_SIZE, 0, FRAME_BG_COLOR, FRAME_BG_COLOR));
+
+    // Title, drawn from title_pix once it has been rendered
+    title_win.reset(display, XCreateSimpleWindow(display, frame_win, TITLE_X, BUTTON_PADDING, 1, BUTTON_SIZE, 0, FRAME_BG_COLOR, FRAME_BG_COLOR));
+
+    // Round the top corners before the frame is mapped
+    rounded = theme.rounded;
+    UpdateShape(display);
 
     // Add client to save set so it will be kept alive if WM crashes
     XAddToSaveSet(display, win_to_frame);
 
+    // The frame draws the border, so ClientRect() doesn't need to know the client's
+    XSetWindowBorderWidth(display, win_to_frame, 0);
+
     // Reparent client window- triggers ReparentNotify which will be ignored
     XReparentWindow(display, win_to_frame, frame_win, CLIENT_OFFSET_X + CLIENT_PADDING_LEFT, CLIENT_OFFSET_Y+BUTTON_PADDING*2 + CLIENT_PADDING_TOP);
 
@@ -54,14 +84,10 @@ void Frame::Create(Display *display, Window root, Window win_to_frame, XWindowAt
     // Map frame- generates MapNotify which will be ignored
     XMapWindow(display, frame_win);
 
-    Pixmap close_pix = LoadImage("close.bmp", display, root);
-    XSetWindowBackgroundPixmap(display, close_win, close_pix);
-
-    Pixmap max_pix = LoadImage("maximize.bmp", display, root);
-    XSetWindowBackgroundPixmap(display, max_win, max_pix);
-
-    Pixmap min_pix = LoadImage("minimize.bmp", display, root);
-    XSetWindowBackgroundPixmap(display, min_win, min_pix);
+    // Button images are shared between all frames
+    XSetWindowBackgroundPixmap(display, close_win, theme.close_pix);
+    XSetWindowBackgroundPixmap(display, max_win, theme.max_pix);
+    XSetWindowBackgroundPixmap(display, min_win, theme.min_pix);
 
     // Map buttons
     XMapWindow(display, close_win);
@@ -69,15 +95,14 @@ void Frame::Create(Display *display, Window root, Window win_to_frame, XWindowAt
     XMapWindow(display, min_win);
 
     UpdateButtonLocations(display);
+    UpdateClientLocation(display);
 
 }
 
 void Frame::UpdateButtonLocations(Display *display) {
-    XWindowAttributes attrs;
-    XGetWindowAttributes(display, frame_win, &attrs);
-    XMoveWindow(display, close_win, attrs.width-BUTTON_SIZE-BUTTON_BORDER_WIDTH*2-BUTTON_PADDING, BUTTON_PADDING);
-    XMoveWindow(display, max_win, attrs.width-2*BUTTON_SIZE-4*BUTTON_BORDER_WIDTH-DISTANCE_BETWEEN_BUTTONS-BUTTON_PADDING, BUTTON_PADDING);
-    XMoveWindow(display, min_win, attrs.width-3*BUTTON_SIZE-6*BUTTON_BORDER_WIDTH-2*DISTANCE_BETWEEN_BUTTONS-BUTTON_PADDING, BUTTON_PADDING);
+    XMoveWindow(display, close_win, size.width-BUTTON_SIZE-BUTTON_BORDER_WIDTH*2-BUTTON_PADDING, BUTTON_PADDING);
+    XMoveWindow(display, max_win, size.width-2*BUTTON_SIZE-4*BUTTON_BORDER_WIDTH-DISTANCE_BETWEEN_BUTTONS-BUTTON_PADDING, BUTTON_PADDING);
+    XMoveWindow(display, min_win, size.width-3*BUTTON_SIZE-6*BUTTON_BORDER_WIDTH-2*DISTANCE_BETWEEN_BUTTONS-BUTTON_PADDING, BUTTON_PADDING);
 }
 
 void Frame::UpdateClientLocation(Display *display) {
@@ -85,14 +110,223 @@ void Frame::UpdateClientLocation(Display *display) {
 }
 
 void Frame::ResizeFrame(Display *display, int width, int height){
+    size = Size<int>(width, height);
+    geometry_changed = true;
+    CheckTitleFit();
     XResizeWindow(display, frame_win, width, height);
     XResizeWindow(display, client_win, width-CLIENT_OFFSET_X, height-CLIENT_OFFSET_Y-2*BUTTON_PADDING);
     UpdateButtonLocations(display);
     UpdateClientLocation(display);
+    UpdateShape(display);
 }
 
 void Frame::MoveFrame(Display *display, int x, int y) {
+    // Buttons and client are positioned relative to frame_win, so only the frame itself moves
+    position = Position<int>(x, y);
+    geometry_changed = true;
     XMoveWindow(display, frame_win, x, y);
+}
+
+void Frame::MoveResizeFrame(Display *display, int x, int y, int width, int height) {
+    if(x != position.x || y != position.y) {
+        if(width != size.width || height != size.height) {
+            position = Position<int>(x, y);
+            size = Size<int>(width, height);
+            geometry_changed = true;
+            CheckTitleFit();
+            XMoveResizeWindow(display, frame_win, x, y, width, height);
+            XResizeWindow(display, client_win, width-CLIENT_OFFSET_X, height-CLIENT_OFFSET_Y-2*BUTTON_PADDING);
+            UpdateButtonLocations(display);
+            UpdateShape(display);
+        } else {
+            MoveFrame(display, x, y);
+        }
+    } else if(width != size.width || height != size.height) {
+        ResizeFrame(display, width, height);
+    }
+}
+
+void Frame::Maximize(Display *display, const Rect<int>& area) {
+    if(!maximized) {
+        restore_rect = Rect<int>(position.x, position.y, size.width, size.height);
+        maximized = true;
+    }
+    MoveFrame(display, area.x, area.y);
+    ResizeFrame(display, area.width - 2*FRAME_BORDER_WIDTH, area.height - 2*FRAME_BORDER_WIDTH);
+}
+
+void Frame::Restore(Display *display) {
+    if(!maximized)
+        return;
+    maximized = false;
+    MoveFrame(display, restore_rect.x, restore_rect.y);
+    ResizeFrame(display, restore_rect.width, restore_rect.height);
+}
+
+void Frame::EnterFullscreen(Display *display, const Rect<int>& output_rect) {
+    if(!fullscreen) {
+        fullscreen_restore_rect = Rect<int>(position.x, position.y, size.width, size.height);
+        fullscreen = true;
+        XUnmapWindow(display, close_win);
+        XUnmapWindow(display, max_win);
+        XUnmapWindow(display, min_win);
+        XUnmapWindow(display, icon_win);
+        XUnmapWindow(display, title_win);
+        XSelectInput(display, frame_win, FULLSCREEN_EVENT_MASK);
+        UpdateShape(display);
+    }
+
+    // Frame and client each reconfigured with a single request
+    position = Position<int>(output_rect.x, output_rect.y);
+    size = Size<int>(output_rect.width, output_rect.height);
+    geometry_changed = true;
+
+    XWindowChanges changes;
+    changes.x = position.x;
+    changes.y = position.y;
+    changes.width = size.width;
+    changes.height = size.height;
+    changes.border_width = 0;
+    XConfigureWindow(display, frame_win, CWX | CWY | CWWidth | CWHeight | CWBorderWidth, &changes);
+    changes.x = changes.y = 0;
+    XConfigureWindow(display, client_win, CWX | CWY | CWWidth | CWHeight, &changes);
+}
+
+void Frame::LeaveFullscreen(Display *display) {
+    if(!fullscreen)
+        return;
+    fullscreen = false;
+    XSelectInput(display, frame_win, FRAME_EVENT_MASK);
+
+    const Rect<int>& r = fullscreen_restore_rect;
+    position = Position<int>(r.x, r.y);
+    size = Size<int>(r.width, r.height);
+    geometry_changed = true;
+    CheckTitleFit();
+
+    XWindowChanges changes;
+    changes.x = position.x;
+    changes.y = position.y;
+    changes.width = size.width;
+    changes.height = size.height;
+    changes.border_width = FRAME_BORDER_WIDTH;
+    XConfigureWindow(display, frame_win, CWX | CWY | CWWidth | CWHeight | CWBorderWidth, &changes);
+    changes.x = CLIENT_OFFSET_X;
+    changes.y = CLIENT_OFFSET_Y+2*BUTTON_PADDING;
+    changes.width = size.width-CLIENT_OFFSET_X;
+    changes.height = size.height-CLIENT_OFFSET_Y-2*BUTTON_PADDING;
+    XConfigureWindow(display, client_win, CWX | CWY | CWWidth | CWHeight, &changes);
+
     UpdateButtonLocations(display);
-    UpdateClientLocation(display);
+    XMapWindow(display, close_win);
+    XMapWindow(display, max_win);
+    XMapWindow(display, min_win);
+    if(icon_pix != None)
+        XMapWindow(display, icon_win);
+    if(title_pix != None)
+        XMapWindow(display, title_win);
+    UpdateShape(display);
+}
+
+void Frame::SetIcon(Display *display, Window root, const uint32_t *pixels, int width, int height) {
+    int screen_num = DefaultScreen(display);
+    Pixmap pix = XCreatePixmap(display, root, width, height, DefaultDepth(display, screen_num));
+
+    // The XImage only borrows the pixels
+    XImage *image = XCreateImage(display, DefaultVisual(display, screen_num), DefaultDepth(display, screen_num), ZPixmap, 0,
+            const_cast<char*>(reinterpret_cast<const char*>(pixels)), width, height, 32, 0);
+    XPutImage(display, pix, DefaultGC(display, screen_num), image, 0, 0, 0, 0, width, height);
+    image->data = nullptr;
+    XDestroyImage(image);
+
+    icon_pix.reset(display, pix);
+
+    // Center the icon in the ICON_SIZE square
+    XMoveResizeWindow(display, icon_win, BUTTON_PADDING+(ICON_SIZE-width)/2, BUTTON_PADDING+(BUTTON_SIZE-height)/2, width, height);
+    XSetWindowBackgroundPixmap(display, icon_win, icon_pix);
+    XClearWindow(display, icon_win);
+    if(!fullscreen)
+        XMapWindow(display, icon_win);
+}
+
+void Frame::UpdateShape(Display *display) {
+    // Maximized and fullscreen frames have square corners so they fill their area
+    int width = rounded && !maximized && !fullscreen ? size.width + 2*FRAME_BORDER_WIDTH : -1;
+    if(width == shape_width_)
+        return;
+    if(width < 0) {
+        CornerShape::Clear(display, frame_win);
+    } else {
+        CornerShape::Apply(display, frame_win, FRAME_BORDER_WIDTH, width, FRAME_CORNER_RADIUS);
+    }
+    shape_width_ = width;
+}
+
+int Frame::TitleSpace() const {
+    // Up to the minimize button, which is the leftmost one
+    return size.width-3*BUTTON_SIZE-6*BUTTON_BORDER_WIDTH-2*DISTANCE_BETWEEN_BUTTONS-BUTTON_PADDING-BUTTON_PADDING-TITLE_X;
+}
+
+void Frame::CheckTitleFit() {
+    int space = TitleSpace();
+    if(space < title_min_space || space >= title_max_space)
+        title_dirty = true;
+}
+
+bool Frame::PaintTitle(Display *display, Window root, GlyphCache& glyphs, GC gc) {
+    title_dirty = false;
+
+    FittedText fitted = glyphs.Fit(display, title, TitleSpace());
+    title_min_space = fitted.min_width;
+    title_max_space = fitted.max_width;
+
+    // Same text as what is already on screen
+    if(fitted.text == title_visible && (title_pix != None || title_visible.empty()))
+        return false;
+
+    title_visible = fitted.text;
+    title_pix.reset();
+    if(title_visible.empty() || fitted.width <= 0) {
+        XUnmapWindow(display, title_win);
+        return true;
+    }
+
+    // Render once into a pixmap the size of the text, the server repaints title_win from it
+    int screen_num = DefaultScreen(display);
+    title_pix.reset(display, XCreatePixmap(display, root, fitted.width, BUTTON_SIZE, DefaultDepth(display, screen_num)));
+    XFillRectangle(display, title_pix, gc, 0, 0, fitted.width, BUTTON_SIZE);
+    glyphs.Draw(display, title_pix, title_visible, 0, 0, BUTTON_SIZE);
+
+    XResizeWindow(display, title_win, fitted.width, BUTTON_SIZE);
+    XSetWindowBackgroundPixmap(display, title_win, title_pix);
+    XClearWindow(display, title_win);
+    XMapWindow(display, title_win);
+    return true;
+}
+
+ResourceCounts Frame::Resources() const {
+    ResourceCounts counts;
+    frame_win.Count(counts);
+    min_win.Count(counts);
+    max_win.Count(counts);
+    close_win.Count(counts);
+    icon_win.Count(counts);
+    icon_pix.Count(counts);
+    title_win.Count(counts);
+    title_pix.Count(counts);
+    return counts;
+}
+
+Rect<int> Frame::OuterRect() const {
+    const int border = fullscreen ? 0 : FRAME_BORDER_WIDTH;
+    return Rect<int>(position.x, position.y, size.width + 2*border, size.height + 2*border);
+}
+
+Rect<int> Frame::ClientRect() const {
+    if(fullscreen)
+        return Rect<int>(position.x, position.y, size.width, size.height);
+
+    // Where UpdateClientLocation() puts it, with the size ResizeFrame() gives it
+    return Rect<int>(position.x + FRAME_BORDER_WIDTH + CLIENT_OFFSET_X, position.y + FRAME_BORDER_WIDTH + CLIENT_OFFSET_Y + 2*BUTTON_PADDING,
+            size.width - CLIENT_OFFSET_X, size.height - CLIENT_OFFSET_Y - 2*BUTTON_PADDING);
 }
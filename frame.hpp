@@ -4,9 +4,13 @@
 extern "C" {
 #include <X11/Xlib.h>
 }
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <unordered_map>
 #include "util.hpp"
+#include "font.hpp"
+#include "resource.hpp"
 
 #define FRAME_BORDER_WIDTH 4
 #define FRAME_BORDER_COLOR 0x0000ff
@@ -30,33 +34,139 @@ extern "C" {
 
 #define BUTTON_SIZE 21
 
+#define FRAME_EVENT_MASK (ExposureMask | SubstructureNotifyMask)
+
+// While fullscreen the WM also watches the pointer crossing the frame
+#define FULLSCREEN_EVENT_MASK (FRAME_EVENT_MASK | EnterWindowMask | LeaveWindowMask)
+
+
+// Button images shared by all frames, loaded once
+struct FrameTheme {
+    void Load(Display *display, Window root);
+
+    OwnedPixmap close_pix, max_pix, min_pix;
+
+    // Whether frames get rounded top corners, which needs the SHAPE extension
+    bool rounded = false;
+};
 
 class Frame {
     public:
 
 
-        void Create(Display *display, Window root, Window win_to_frame, XWindowAttributes attrs);
+        void Create(Display *display, Window root, Window win_to_frame, XWindowAttributes attrs, const FrameTheme& theme);
 
         void MoveFrame(Display *display, int x, int y);
 
         void ResizeFrame(Display *display, int width, int height);
 
+        // Move and resize the frame at once. Sends nothing if the geometry is unchanged
+        void MoveResizeFrame(Display *display, int x, int y, int width, int height);
+
+        // Resize the frame to fill area (outer edges, including the border), remembering the old geometry
+        void Maximize(Display *display, const Rect<int>& area);
+
+        // Return a maximized frame to the geometry it had before Maximize()
+        void Restore(Display *display);
+
+        // Cover output_rect with the client alone: no border, buttons, icon, title or rounded corners.
+        // The current geometry is kept for LeaveFullscreen()
+        void EnterFullscreen(Display *display, const Rect<int>& output_rect);
+
+        // Put the decorations back and return to the geometry from before EnterFullscreen()
+        void LeaveFullscreen(Display *display);
+
+        // Geometry of the frame including its border, in root coordinates
+        Rect<int> OuterRect() const;
+
+        // Geometry of the client window, in root coordinates
+        Rect<int> ClientRect() const;
+
+        // Show an icon in the titlebar. pixels are opaque 0xAARRGGBB, as produced by IconLoader
+        void SetIcon(Display *display, Window root, const uint32_t *pixels, int width, int height);
+
+        // Fit title into the titlebar and render it into title_pix if the visible text changed.
+        // gc fills the background. Returns whether anything was rendered
+        bool PaintTitle(Display *display, Window root, GlyphCache& glyphs, GC gc);
+
+        // Server resources owned by this frame
+        ResourceCounts Resources() const;
+
         ~Frame();
 
-        // Master window of the frame
-        Window frame_win;
+        // Master window of the frame. Declared first so it is destroyed after its subwindows
+        OwnedWindow frame_win;
 
         // Client window
         Window client_win;
 
         // Button windows
-        Window min_win, max_win, close_win;
+        OwnedWindow min_win, max_win, close_win;
+
+        // Application icon at the left of the titlebar, unmapped until the icon has been loaded
+        OwnedWindow icon_win;
+        OwnedPixmap icon_pix;
+
+        // Bumped for every icon request so results of outdated requests can be dropped
+        unsigned icon_generation = 0;
+
+        // Window title, and the part of it that is drawn in title_win from title_pix
+        OwnedWindow title_win;
+        OwnedPixmap title_pix;
+        ::std::string title;
+        ::std::string title_visible;
+
+        // Titlebar widths for which title_visible stays the same, a resize outside them needs a repaint
+        int title_min_space = 0, title_max_space = 0;
+
+        // Whether the title property has to be fetched again, and whether the title has to be painted
+        bool title_changed = true;
+        bool title_dirty = true;
+
+        // When the title was last rendered, in milliseconds, used to rate limit repaints
+        long title_painted_at = 0;
+
+        // Cached geometry of frame_win, kept in sync by Create(), MoveFrame() and ResizeFrame()
+        // so callers don't need a XGetGeometry round trip
+        Position<int> position;
+        Size<int> size;
+
+        // Set whenever the geometry changes, cleared once the change has been reported over IPC
+        bool geometry_changed = false;
+
+        // Whether the frame is maximized, and the geometry to go back to
+        bool maximized = false;
+        Rect<int> restore_rect;
+
+        // Whether the client is fullscreen, and the frame geometry to go back to
+        bool fullscreen = false;
+        Rect<int> fullscreen_restore_rect;
+
+        // Whether the frame has rounded top corners while it isn't maximized or fullscreen
+        bool rounded = false;
+
+        // Whether the frame is arranged by a tiling layout, and its floating geometry from before that
+        bool tiled = false;
+        Rect<int> floating_rect;
 
     private:
 
         void UpdateButtonLocations(Display *display);
         void UpdateClientLocation(Display *display);
 
+        // Reshape the frame after a resize or a change of maximized. The shape only depends on the
+        // width, so nothing is sent while just the height changes
+        void UpdateShape(Display *display);
+
+        // Outer width the current shape was made for, -1 while the frame is unshaped
+        int shape_width_ = -1;
+
+        // Width left for the title between the icon and the buttons
+        int TitleSpace() const;
+
+        // Mark the title dirty if the titlebar width crossed a truncation boundary
+        void CheckTitleFit();
+
 };
 
 #endif
@@ -0,0 +1,173 @@
+#include "icon.hpp"
+#include "scale.hpp"
+#include "trace.hpp"
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+}
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+
+using namespace std;
+
+bool IconLoader::Start(const char *display_name, uint32_t background) {
+    background_ = background;
+
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(wake_fd < 0) {
+        perror("eventfd");
+        return false;
+    }
+
+    for(int i = 0; i < ICON_WORKERS; ++i) {
+        Display *display = XOpenDisplay(display_name);
+        if(display == nullptr) {
+            fprintf(stderr, "Icon worker failed to open X display\n");
+            return !workers_.empty();
+        }
+        displays_.push_back(display);
+        workers_.emplace_back(&IconLoader::WorkerLoop, this, display);
+    }
+    return true;
+}
+
+IconLoader::~IconLoader() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_workers_.notify_all();
+    for(thread& worker : workers_) {
+        worker.join();
+    }
+    for(Display *display : displays_) {
+        XCloseDisplay(display);
+    }
+
+    IconResult *result = TakeResults();
+    while(result) {
+        IconResult *next = result->next;
+        delete result;
+        result = next;
+    }
+
+    if(wake_fd >= 0)
+        close(wake_fd);
+}
+
+void IconLoader::Request(Window client_win, unsigned generation) {
+    if(workers_.empty())
+        return;
+    {
+        lock_guard<mutex> lock(mutex_);
+        auto it = pending_.find(client_win);
+        if(it != pending_.end()) {
+            it->second = generation;
+            return;
+        }
+        pending_[client_win] = generation;
+        queue_.push_back(client_win);
+    }
+    wake_workers_.notify_one();
+}
+
+IconResult* IconLoader::TakeResults() {
+    // Clear the eventfd counter, then take the whole list
+    uint64_t count;
+    if(wake_fd >= 0)
+        while(read(wake_fd, &count, sizeof(count)) > 0) {}
+    return results_.exchange(nullptr, memory_order_acquire);
+}
+
+void IconLoader::Publish(IconResult *result) {
+    result->next = results_.load(memory_order_relaxed);
+    while(!results_.compare_exchange_weak(result->next, result, memory_order_release, memory_order_relaxed)) {}
+
+    uint64_t one = 1;
+    if(write(wake_fd, &one, sizeof(one)) < 0) {
+        // The counter is already non-zero, the event loop will wake up anyway
+    }
+}
+
+void IconLoader::WorkerLoop(Display *display) {
+    TraceThreadName("icon worker");
+    const Atom net_wm_icon = TRACE_CALL("XInternAtom", XInternAtom(display, "_NET_WM_ICON", false));
+
+    for(;;) {
+        Window client_win;
+        unsigned generation;
+        {
+            unique_lock<mutex> lock(mutex_);
+            wake_workers_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if(stopping_)
+                return;
+            client_win = queue_.front();
+            queue_.pop_front();
+            generation = pending_[client_win];
+            pending_.erase(client_win);
+        }
+
+        IconResult *result = Load(display, net_wm_icon, client_win, generation);
+        if(result)
+            Publish(result);
+    }
+}
+
+IconResult* IconLoader::Load(Display *display, Atom net_wm_icon, Window client_win, unsigned generation) {
+    Atom type;
+    int format;
+    unsigned long num_items, bytes_after;
+    unsigned char *data = nullptr;
+    TRACE_SPAN("LoadIcon");
+    if(TRACE_CALL("XGetWindowProperty", XGetWindowProperty(display, client_win, net_wm_icon, 0, 1L << 24, false, XA_CARDINAL,
+                &type, &format, &num_items, &bytes_after, &data)) != Success || data == nullptr) {
+        return nullptr;
+    }
+
+    // Xlib hands out 32-bit properties as longs. The property is a list of width, height, pixels...
+    const unsigned long *items = reinterpret_cast<const unsigned long*>(data);
+    const unsigned long *best = nullptr;
+    unsigned long best_width = 0, best_height = 0;
+    for(unsigned long i = 0; format == 32 && i + 2 <= num_items;) {
+        unsigned long width = items[i], height = items[i + 1];
+        if(width == 0 || height == 0 || width*height > num_items - i - 2)
+            break;
+
+        // Prefer the smallest icon that is at least ICON_SIZE, otherwise the largest one
+        bool big_enough = width >= ICON_SIZE && height >= ICON_SIZE;
+        bool best_big_enough = best_width >= ICON_SIZE && best_height >= ICON_SIZE;
+        if(!best || (big_enough && (!best_big_enough || width*height < best_width*best_height))
+                || (!big_enough && !best_big_enough && width*height > best_width*best_height)) {
+            best = items + i + 2;
+            best_width = width;
+            best_height = height;
+        }
+        i += 2 + width*height;
+    }
+
+    if(!best) {
+        XFree(data);
+        return nullptr;
+    }
+
+    vector<uint32_t> source(best_width*best_height);
+    for(size_t i = 0; i < source.size(); ++i) {
+        source[i] = uint32_t(best[i]);
+    }
+    XFree(data);
+
+    // Fit into ICON_SIZE, keeping the aspect ratio
+    IconResult *result = new IconResult;
+    result->client_win = client_win;
+    result->generation = generation;
+    result->width = best_width >= best_height ? ICON_SIZE : max(1, int(ICON_SIZE*best_width/best_height));
+    result->height = best_height >= best_width ? ICON_SIZE : max(1, int(ICON_SIZE*best_height/best_width));
+    result->pixels.resize(result->width*result->height);
+    result->next = nullptr;
+
+    DownscalePremultiplied(source.data(), best_width, best_height, result->pixels.data(), result->width, result->height);
+    BlendOver(result->pixels.data(), result->pixels.size(), background_);
+    return result;
+}
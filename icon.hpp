@@ -0,0 +1,83 @@
+#ifndef ICON_HPP
+#define ICON_HPP
+
+extern "C" {
+#include <X11/Xlib.h>
+}
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Size of the icon in the titlebar
+#define ICON_SIZE 16
+
+// Number of threads fetching and scaling icons
+#define ICON_WORKERS 2
+
+// A scaled icon, ready to be uploaded to a pixmap
+struct IconResult {
+    Window client_win;
+
+    // Frame::icon_generation at the time of the request, results for older generations are stale
+    unsigned generation;
+
+    int width, height;
+
+    // Opaque pixels, already composited over the titlebar color
+    ::std::vector<uint32_t> pixels;
+
+    // Next result in the completed list
+    IconResult *next;
+};
+
+// Fetches _NET_WM_ICON and scales it on worker threads, so the event loop never waits
+// for the (often several hundred KB) property. Each worker has its own X connection
+class IconLoader {
+    public:
+        // Start the workers, connecting them to display_name. Returns false if that fails
+        bool Start(const char *display_name, uint32_t background);
+
+        // Stop and join the workers
+        ~IconLoader();
+
+        // Queue a fetch of the icon of client_win. A request for a window that is already
+        // queued only updates the generation
+        void Request(Window client_win, unsigned generation);
+
+        // Take all finished icons. The caller deletes them
+        IconResult* TakeResults();
+
+        // Becomes readable when results are available, for the event loop to poll
+        int wake_fd = -1;
+
+    private:
+        void WorkerLoop(Display *display);
+
+        // Fetch, pick and scale one icon. Returns nullptr if the window has no usable icon
+        IconResult* Load(Display *display, Atom net_wm_icon, Window client_win, unsigned generation);
+
+        // Push a result onto the completed list without taking a lock
+        void Publish(IconResult *result);
+
+        uint32_t background_;
+
+        ::std::vector<::std::thread> workers_;
+        ::std::vector<Display*> displays_;
+
+        // Pending requests, in order, and their latest generation
+        ::std::mutex mutex_;
+        ::std::condition_variable wake_workers_;
+        ::std::deque<Window> queue_;
+        ::std::unordered_map<Window, unsigned> pending_;
+        bool stopping_ = false;
+
+        // Completed results, a lock-free stack the event loop empties all at once
+        ::std::atomic<IconResult*> results_{nullptr};
+};
+
+#endif
@@ -2,8 +2,10 @@
 #include <X11/Xlib.h>
 #include <cstdio>
 #include <iostream>
+#include "trace.hpp"
 
 Pixmap LoadImage(const char *file, Display *display, Window root) {
+    TRACE_SPAN("LoadImage");
     Imlib_Image img = imlib_load_image(file);
     if (!img) {
         fprintf(stderr, "Cannot load image: %s", file);
@@ -27,6 +29,28 @@ Pixmap LoadImage(const char *file, Display *display, Window root) {
 
     imlib_render_image_on_drawable(0, 0);
 
+    // The pixels now live in the pixmap
+    imlib_free_image();
+
     return pix;
 
 }
+
+bool LoadImagePixels(const char *file, std::vector<uint32_t>& pixels, int& width, int& height) {
+    TRACE_SPAN("LoadImagePixels");
+    Imlib_Image img = imlib_load_image(file);
+    if (!img) {
+        fprintf(stderr, "Cannot load image: %s\n", file);
+        return false;
+    }
+
+    imlib_context_set_image(img);
+    width = imlib_image_get_width();
+    height = imlib_image_get_height();
+
+    const DATA32 *data = imlib_image_get_data_for_reading_only();
+    pixels.assign(data, data + size_t(width)*height);
+
+    imlib_free_image();
+    return true;
+}
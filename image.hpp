@@ -7,7 +7,12 @@ extern "C" {
 #include <Imlib2.h>
 #include <cstdio>
 #include <iostream>
+#include <cstdint>
+#include <vector>
 
 Pixmap LoadImage(const char *file, Display *display, Window root);
 
+// Decode file into 0xAARRGGBB pixels without creating a pixmap. Returns false if it can't be loaded
+bool LoadImagePixels(const char *file, ::std::vector<uint32_t>& pixels, int& width, int& height);
+
 #endif
@@ -0,0 +1,229 @@
+#include "ipc.hpp"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+string IpcSocketPath(const string& display_name) {
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    string dir;
+    if(runtime_dir && *runtime_dir) {
+        dir = runtime_dir;
+    } else {
+        // /tmp is shared, so only a directory that belongs to this user and nobody else can enter will do
+        dir = "/tmp/linuxxp-" + to_string(getuid());
+        if(mkdir(dir.c_str(), 0700) < 0 && errno != EEXIST) {
+            perror("IPC directory");
+            return string();
+        }
+        struct stat st;
+        if(lstat(dir.c_str(), &st) < 0 || !S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 077)) {
+            fprintf(stderr, "Not using %s for the IPC socket, it isn't a private directory of this user\n", dir.c_str());
+            return string();
+        }
+    }
+    return dir + "/linuxxp-" + display_name + ".sock";
+}
+
+bool IpcServer::Start(const string& socket_path) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(socket_path.size() >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "IPC socket path too long: %s\n", socket_path.c_str());
+        return false;
+    }
+    strcpy(addr.sun_path, socket_path.c_str());
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listen_fd_ < 0) {
+        perror("IPC socket");
+        return false;
+    }
+
+    // A socket left behind by a previous run would make bind() fail
+    unlink(socket_path.c_str());
+
+    // Only this user may connect. The umask covers the moment between bind() and chmod()
+    const mode_t old_umask = umask(077);
+    const bool bound = bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+    umask(old_umask);
+    if(!bound || chmod(socket_path.c_str(), 0600) < 0 || listen(listen_fd_, 16) < 0) {
+        perror("IPC bind");
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+
+    path = socket_path;
+    return true;
+}
+
+IpcServer::~IpcServer() {
+    for(auto& client : clients_) {
+        close(client.first);
+    }
+    if(listen_fd_ >= 0) {
+        close(listen_fd_);
+        unlink(path.c_str());
+    }
+}
+
+void IpcServer::AddPollFds(vector<pollfd>& fds) const {
+    if(listen_fd_ < 0)
+        return;
+    fds.push_back({ listen_fd_, POLLIN, 0 });
+    for(const auto& client : clients_) {
+        short events = POLLIN;
+        if(!client.second.out.empty())
+            events |= POLLOUT;
+        fds.push_back({ client.first, events, 0 });
+    }
+}
+
+void IpcServer::HandleEvents(const vector<pollfd>& fds, size_t first, vector<IpcMessage>& messages) {
+    if(listen_fd_ < 0 || first >= fds.size())
+        return;
+
+    // Accept first. The polled clients are all still open, so a new descriptor can't be mistaken for one of
+    // them, and a descriptor closed below can't be reused before its messages have been answered
+    if(fds[first].revents & POLLIN)
+        Accept();
+
+    for(size_t i = first + 1; i < fds.size(); ++i) {
+        if(!fds[i].revents)
+            continue;
+        auto it = clients_.find(fds[i].fd);
+        if(it == clients_.end())
+            continue;
+
+        bool keep = !(fds[i].revents & (POLLERR | POLLNVAL));
+        if(keep && (fds[i].revents & (POLLIN | POLLHUP)))
+            keep = Read(fds[i].fd, it->second, messages);
+        if(keep && (fds[i].revents & POLLOUT))
+            keep = Write(fds[i].fd, it->second);
+        if(!keep)
+            Disconnect(fds[i].fd);
+    }
+}
+
+void IpcServer::Accept() {
+    for(;;) {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0)
+            return;
+
+        // Refuse other users, in case the socket's permissions aren't enforced
+        ucred cred;
+        socklen_t cred_length = sizeof(cred);
+        if(getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_length) < 0 || cred.uid != getuid()) {
+            close(fd);
+            continue;
+        }
+        clients_[fd] = Client();
+    }
+}
+
+bool IpcServer::Read(int fd, Client& client, vector<IpcMessage>& messages) {
+    char buf[65536];
+    bool open = true;
+    for(;;) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if(n > 0) {
+            client.in.append(buf, n);
+            continue;
+        }
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+
+        // Closed or failed, but still handle what was sent before that
+        open = false;
+        break;
+    }
+
+    // Split off every complete message
+    size_t pos = 0;
+    while(client.in.size() - pos >= sizeof(IpcHeader)) {
+        IpcHeader header;
+        memcpy(&header, client.in.data() + pos, sizeof(header));
+        if(header.length > IPC_MAX_MESSAGE)
+            return false;
+        if(client.in.size() - pos - sizeof(header) < header.length)
+            break;
+        messages.push_back({ fd, header.type, client.in.substr(pos + sizeof(header), header.length) });
+        pos += sizeof(header) + header.length;
+    }
+    client.in.erase(0, pos);
+    return open;
+}
+
+bool IpcServer::Write(int fd, Client& client) {
+    size_t pos = 0;
+    while(pos < client.out.size()) {
+        ssize_t n = write(fd, client.out.data() + pos, client.out.size() - pos);
+        if(n > 0) {
+            pos += n;
+            continue;
+        }
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        return false;
+    }
+    client.out.erase(0, pos);
+    return client.out.size() <= IPC_MAX_BACKLOG;
+}
+
+void IpcServer::Disconnect(int fd) {
+    close(fd);
+    clients_.erase(fd);
+}
+
+void IpcServer::Send(int fd, uint32_t type, const void *data, size_t length) {
+    auto it = clients_.find(fd);
+    if(it == clients_.end())
+        return;
+
+    IpcHeader header = { uint32_t(length), type };
+    it->second.out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    it->second.out.append(reinterpret_cast<const char*>(data), length);
+
+    // Try to send right away, whatever is left goes out when the socket is writable
+    if(!Write(fd, it->second))
+        Disconnect(fd);
+}
+
+void IpcServer::Broadcast(const IpcEvent& event) {
+    vector<int> receivers;
+    for(const auto& client : clients_) {
+        if(client.second.events & event.event)
+            receivers.push_back(client.first);
+    }
+    for(int fd : receivers) {
+        Send(fd, IPC_EVENT, &event, sizeof(event));
+    }
+}
+
+void IpcServer::Subscribe(int fd, uint32_t mask) {
+    auto it = clients_.find(fd);
+    if(it != clients_.end())
+        it->second.events = mask;
+}
+
+bool IpcServer::HasSubscribers(uint32_t mask) const {
+    for(const auto& client : clients_) {
+        if(client.second.events & mask)
+            return true;
+    }
+    return false;
+}
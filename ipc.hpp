@@ -0,0 +1,148 @@
+#ifndef IPC_HPP
+#define IPC_HPP
+
+#include <poll.h>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Control socket protocol. Every message in both directions is an IpcHeader followed by
+// length bytes of payload. All integers are in host byte order
+//
+//   IPC_COMMAND   payload: IpcCommand[n]      reply: int32_t status[n], 1 if the command was applied
+//   IPC_GET_TREE  payload: none               reply: IpcWindowInfo[n] for every managed window
+//   IPC_SUBSCRIBE payload: uint32_t mask      reply: uint32_t mask, the IPC_EVENT_* bits now subscribed
+//   IPC_EVENT     sent to subscribers, payload: IpcEvent
+//   IPC_GET_RESOURCES payload: none           reply: IpcResources for the whole WM (window 0), then one per frame
+//
+// All commands of one IPC_COMMAND message are applied together, before the WM looks at the next X event
+
+// Maximum size of one message payload
+#define IPC_MAX_MESSAGE (1 << 20)
+
+// A client that has this much unsent output is disconnected
+#define IPC_MAX_BACKLOG (4 << 20)
+
+enum IpcMessageType : uint32_t {
+    IPC_COMMAND = 1,
+    IPC_GET_TREE = 2,
+    IPC_SUBSCRIBE = 3,
+    IPC_EVENT = 4,
+    IPC_GET_RESOURCES = 5,
+};
+
+enum IpcOp : uint32_t {
+    IPC_MOVE = 1,   // a, b: new x, y of the frame
+    IPC_RESIZE = 2, // a, b: new width, height of the frame
+    IPC_FOCUS = 3,
+    IPC_CLOSE = 4,
+    IPC_RAISE = 5,
+};
+
+enum IpcEventMask : uint32_t {
+    IPC_EVENT_MAP = 1 << 0,
+    IPC_EVENT_UNMAP = 1 << 1,
+    IPC_EVENT_FOCUS = 1 << 2,
+    IPC_EVENT_GEOMETRY = 1 << 3,
+};
+
+enum IpcWindowFlags : uint32_t {
+    IPC_WINDOW_FOCUSED = 1 << 0,
+    IPC_WINDOW_MAXIMIZED = 1 << 1,
+    IPC_WINDOW_TILED = 1 << 2,
+    IPC_WINDOW_FULLSCREEN = 1 << 3,
+};
+
+struct IpcHeader {
+    uint32_t length;
+    uint32_t type;
+};
+
+struct IpcCommand {
+    uint32_t op;
+    uint32_t window; // Client window
+    int32_t a, b;
+};
+
+struct IpcWindowInfo {
+    uint32_t window; // Client window
+    int32_t x, y;    // Frame geometry
+    int32_t width, height;
+    uint32_t flags;
+};
+
+struct IpcEvent {
+    uint32_t event; // One IPC_EVENT_* bit
+    uint32_t window;
+    int32_t x, y;
+    int32_t width, height;
+};
+
+// Live X server resources created by the WM
+struct IpcResources {
+    uint32_t window; // Client window of the frame, 0 for the totals
+    int32_t pixmaps, windows, cursors, gcs;
+};
+
+// A complete message received from a client
+struct IpcMessage {
+    int client;
+    uint32_t type;
+    ::std::string payload;
+};
+
+// Socket path for the WM on display_name: in $XDG_RUNTIME_DIR, or else in /tmp/linuxxp-<uid>, which is
+// created with mode 0700 and refused if it belongs to someone else or others can enter it. Empty if there is no safe place
+::std::string IpcSocketPath(const ::std::string& display_name);
+
+// Non-blocking UNIX socket server driven by the WM's event loop. It never blocks and owns no thread:
+// the loop polls the descriptors from AddPollFds() and passes the results to HandleEvents()
+class IpcServer {
+    public:
+        // Listen on path, replacing a stale socket, with only this user allowed to connect. Returns false if that fails
+        bool Start(const ::std::string& path);
+
+        // Disconnect all clients and remove the socket
+        ~IpcServer();
+
+        // Append the descriptors to wait on
+        void AddPollFds(::std::vector<pollfd>& fds) const;
+
+        // Accept, read and write on the descriptors that are ready, starting at fds[first].
+        // Complete messages are appended to messages
+        void HandleEvents(const ::std::vector<pollfd>& fds, size_t first, ::std::vector<IpcMessage>& messages);
+
+        // Queue a message to one client
+        void Send(int client, uint32_t type, const void *data, size_t length);
+
+        // Queue an event to every client subscribed to it
+        void Broadcast(const IpcEvent& event);
+
+        // Set the IPC_EVENT_* bits a client is subscribed to
+        void Subscribe(int client, uint32_t mask);
+
+        // Whether anyone is subscribed to one of the events in mask
+        bool HasSubscribers(uint32_t mask) const;
+
+        ::std::string path;
+
+    private:
+        struct Client {
+            ::std::string in, out;
+            uint32_t events = 0;
+        };
+
+        void Accept();
+
+        // Returns false if the client has to be disconnected
+        bool Read(int fd, Client& client, ::std::vector<IpcMessage>& messages);
+        bool Write(int fd, Client& client);
+
+        void Disconnect(int fd);
+
+        int listen_fd_ = -1;
+        ::std::unordered_map<int, Client> clients_;
+};
+
+#endif
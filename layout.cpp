@@ -0,0 +1,118 @@
+#include "layout.hpp"
+#include "frame.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// Split length into count parts that differ by at most one pixel, with gap pixels between them. Only as many
+// parts as are at least min_part long are made, the rest repeat the last one
+void Split(int start, int length, int count, int gap, int min_part, vector<int>& starts, vector<int>& lengths) {
+    const int parts = max(1, min(count, (length + gap) / (min_part + gap)));
+    const int usable = length - gap*(parts - 1);
+    int pos = start;
+    for(int i = 0; i < count; ++i) {
+        if(i >= parts) {
+            starts.push_back(starts.back());
+            lengths.push_back(lengths.back());
+            continue;
+        }
+        int part = usable / parts + (i < usable % parts ? 1 : 0);
+        starts.push_back(pos);
+        lengths.push_back(part);
+        pos += part + gap;
+    }
+}
+
+void TileMasterStack(const Rect<int>& area, int n, vector<Rect<int>>& rects) {
+    if(n == 1) {
+        rects.push_back(area);
+        return;
+    }
+
+    // Too narrow for two columns, so everything is stacked on one tile
+    const int master_width = max(TILE_MIN_WIDTH, int(area.width * MASTER_RATIO) - TILE_GAP/2);
+    if(area.width - master_width - TILE_GAP < TILE_MIN_WIDTH) {
+        rects.assign(n, area);
+        return;
+    }
+    rects.emplace_back(area.x, area.y, master_width, area.height);
+
+    // The rest are stacked on the right
+    vector<int> ys, heights;
+    Split(area.y, area.height, n - 1, TILE_GAP, TILE_MIN_HEIGHT, ys, heights);
+    const int stack_x = area.x + master_width + TILE_GAP;
+    for(int i = 0; i < n - 1; ++i) {
+        rects.emplace_back(stack_x, ys[i], area.x + area.width - stack_x, heights[i]);
+    }
+}
+
+void TileGrid(const Rect<int>& area, int n, vector<Rect<int>>& rects) {
+    const int cols = int(ceil(sqrt(double(n))));
+    const int rows = (n + cols - 1) / cols;
+
+    vector<int> ys, heights;
+    Split(area.y, area.height, rows, TILE_GAP, TILE_MIN_HEIGHT, ys, heights);
+    for(int row = 0; row < rows; ++row) {
+        // The last row may have fewer frames, they share its whole width
+        const int in_row = min(cols, n - row*cols);
+        vector<int> xs, widths;
+        Split(area.x, area.width, in_row, TILE_GAP, TILE_MIN_WIDTH, xs, widths);
+        for(int col = 0; col < in_row; ++col) {
+            rects.emplace_back(xs[col], ys[row], widths[col], heights[row]);
+        }
+    }
+}
+
+void TileColumns(const Rect<int>& area, int n, vector<Rect<int>>& rects) {
+    vector<int> xs, widths;
+    Split(area.x, area.width, n, TILE_GAP, TILE_MIN_WIDTH, xs, widths);
+    for(int i = 0; i < n; ++i) {
+        rects.emplace_back(xs[i], area.y, widths[i], area.height);
+    }
+}
+
+}
+
+Layout NextLayout(Layout layout) {
+    switch(layout) {
+        case Layout::Floating: return Layout::MasterStack;
+        case Layout::MasterStack: return Layout::Grid;
+        case Layout::Grid: return Layout::Columns;
+        case Layout::Columns: return Layout::Floating;
+    }
+    return Layout::Floating;
+}
+
+vector<Rect<int>> TileLayout(Layout layout, const Rect<int>& area, int n) {
+    vector<Rect<int>> rects;
+    if(n <= 0 || layout == Layout::Floating)
+        return rects;
+    rects.reserve(n);
+
+    const Rect<int> inner(area.x + TILE_GAP, area.y + TILE_GAP, area.width - 2*TILE_GAP, area.height - 2*TILE_GAP);
+    switch(layout) {
+        case Layout::MasterStack:
+            TileMasterStack(inner, n, rects);
+            break;
+        case Layout::Grid:
+            TileGrid(inner, n, rects);
+            break;
+        case Layout::Columns:
+            TileColumns(inner, n, rects);
+            break;
+        case Layout::Floating:
+            break;
+    }
+
+    // Only an area that is itself smaller than one tile gets here
+    for(Rect<int>& r : rects) {
+        r.width = max(r.width, TILE_MIN_WIDTH);
+        r.height = max(r.height, TILE_MIN_HEIGHT);
+    }
+    return rects;
+}
@@ -0,0 +1,35 @@
+#ifndef LAYOUT_HPP
+#define LAYOUT_HPP
+
+#include <vector>
+#include "util.hpp"
+#include "frame.hpp"
+
+// Share of the work area given to the master frame in the master-stack layout
+#define MASTER_RATIO 0.55
+
+// Gap between tiled frames and around the edge of the work area
+#define TILE_GAP BUTTON_PADDING
+
+// Smallest outer rectangle of a tiled frame, which leaves the client at least one pixel each way.
+// When there isn't room for every frame at this size the extra frames are stacked on the last tile
+#define TILE_MIN_WIDTH (2*FRAME_BORDER_WIDTH + CLIENT_OFFSET_X + 1)
+#define TILE_MIN_HEIGHT (2*FRAME_BORDER_WIDTH + CLIENT_OFFSET_Y + 2*BUTTON_PADDING + 1)
+
+// How the frames of an output are arranged
+enum class Layout {
+    Floating,
+    MasterStack,
+    Grid,
+    Columns,
+};
+
+// Layout that follows layout when cycling through them
+Layout NextLayout(Layout layout);
+
+// Outer rectangles (including the frame border) for n frames tiled in area, in frame order. None is smaller
+// than TILE_MIN_WIDTH x TILE_MIN_HEIGHT.
+// Pure function so the whole arrangement can be computed before anything is sent to the X server
+::std::vector<Rect<int>> TileLayout(Layout layout, const Rect<int>& area, int n);
+
+#endif
@@ -0,0 +1,42 @@
+// Checks that TileLayout never makes a tile smaller than the minimum, however many frames share an output.
+// Build and run with make test-layout
+#include <cstdio>
+#include <vector>
+#include "layout.hpp"
+
+using namespace std;
+
+int main() {
+    const Rect<int> areas[] = { Rect<int>(0, 0, 1920, 1050), Rect<int>(1920, 0, 320, 200), Rect<int>(0, 0, 10, 10) };
+    int failures = 0;
+
+    for(const Rect<int>& area : areas) {
+        for(Layout layout : { Layout::MasterStack, Layout::Grid, Layout::Columns }) {
+            // Enough frames to pass the minimum on every axis of every area
+            for(int n : { 1, 2, 3, 10, 50, 100, 500, 2000 }) {
+                const vector<Rect<int>> rects = TileLayout(layout, area, n);
+                if(int(rects.size()) != n) {
+                    printf("FAIL layout %d, %dx%d, n=%d: %zu rects\n", int(layout), area.width, area.height, n, rects.size());
+                    ++failures;
+                    continue;
+                }
+                const bool fits = area.width >= TILE_MIN_WIDTH + 2*TILE_GAP && area.height >= TILE_MIN_HEIGHT + 2*TILE_GAP;
+                for(const Rect<int>& r : rects) {
+                    const bool inside = r.x >= area.x && r.y >= area.y
+                        && r.x + r.width <= area.x + area.width && r.y + r.height <= area.y + area.height;
+                    if(r.width < TILE_MIN_WIDTH || r.height < TILE_MIN_HEIGHT || (fits && !inside)) {
+                        printf("FAIL layout %d, %dx%d, n=%d: tile %d,%d %dx%d\n", int(layout), area.width, area.height, n,
+                                r.x, r.y, r.width, r.height);
+                        ++failures;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    if(failures)
+        return 1;
+    printf("All tiles at least %dx%d\n", TILE_MIN_WIDTH, TILE_MIN_HEIGHT);
+    return 0;
+}
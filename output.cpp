@@ -0,0 +1,194 @@
+#include "output.hpp"
+#include <X11/X.h>
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+}
+#include "util.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+
+using namespace std;
+
+Rect<int> Output::WorkArea() const {
+    return Rect<int>(rect.x, rect.y, rect.width, rect.height - BAR_HEIGHT);
+}
+
+void OutputTable::Create(Display *display, Window root) {
+    int error_base;
+    randr_ = TRACE_CALL("XRRQueryExtension", XRRQueryExtension(display, &event_base_, &error_base));
+
+    vector<Rect<int>> changed;
+    if(randr_) {
+        // Only output changes are needed, the screen itself is handled through the CRTCs
+        XRRSelectInput(display, root, RRScreenChangeNotifyMask | RRCrtcChangeNotifyMask);
+        Refresh(display, root, changed);
+    }
+
+    EnsureOutput(display, root, changed);
+}
+
+bool OutputTable::HandleEvent(Display *display, Window root, XEvent& e, vector<Rect<int>>& changed) {
+    if(!randr_)
+        return false;
+
+    if(e.type == event_base_ + RRScreenChangeNotify) {
+        // Let Xlib update the screen size, then pick up any CRTC that was not reported separately
+        XRRUpdateConfiguration(&e);
+        Refresh(display, root, changed);
+        EnsureOutput(display, root, changed);
+        return true;
+    }
+
+    if(e.type == event_base_ + RRNotify) {
+        const XRRNotifyEvent& notify = reinterpret_cast<const XRRNotifyEvent&>(e);
+        if(notify.subtype != RRNotify_CrtcChange)
+            return true;
+
+        // The event carries the new CRTC geometry, so no round trip is needed
+        const XRRCrtcChangeNotifyEvent& crtc = reinterpret_cast<const XRRCrtcChangeNotifyEvent&>(e);
+        if(crtc.mode == None || crtc.width == 0 || crtc.height == 0) {
+            RemoveOutput(crtc.crtc, changed);
+        } else {
+            int width = crtc.width, height = crtc.height;
+            if(crtc.rotation & (RR_Rotate_90 | RR_Rotate_270))
+                swap(width, height);
+            UpdateOutput(display, root, crtc.crtc, Rect<int>(crtc.x, crtc.y, width, height), changed);
+        }
+        EnsureOutput(display, root, changed);
+        return true;
+    }
+
+    return false;
+}
+
+void OutputTable::UpdateOutput(Display *display, Window root, RRCrtc crtc, const Rect<int>& rect, vector<Rect<int>>& changed) {
+    // A real output replaces the fallback one
+    if(crtc != None)
+        RemoveOutput(None, changed);
+
+    for(Output& output : outputs) {
+        if(output.crtc != crtc)
+            continue;
+
+        if(output.rect != rect) {
+            changed.push_back(output.rect);
+            changed.push_back(rect);
+            output.rect = rect;
+            output.bar.Move(display, rect);
+        }
+        return;
+    }
+
+    Output output;
+    output.crtc = crtc;
+    output.rect = rect;
+    output.bar.Create(display, root, rect);
+    outputs.push_back(move(output));
+    changed.push_back(rect);
+}
+
+void OutputTable::RemoveOutput(RRCrtc crtc, vector<Rect<int>>& changed) {
+    for(auto it = outputs.begin(); it != outputs.end(); ++it) {
+        if(it->crtc == crtc) {
+            // The bar goes with the output
+            changed.push_back(it->rect);
+            outputs.erase(it);
+            return;
+        }
+    }
+}
+
+void OutputTable::Refresh(Display *display, Window root, vector<Rect<int>>& changed) {
+    XRRScreenResources *resources = TRACE_CALL("XRRGetScreenResourcesCurrent", XRRGetScreenResourcesCurrent(display, root));
+    if(!resources)
+        return;
+
+    // Collect the active CRTCs
+    vector<pair<RRCrtc, Rect<int>>> active;
+    for(int i = 0; i < resources->ncrtc; ++i) {
+        XRRCrtcInfo *info = TRACE_CALL("XRRGetCrtcInfo", XRRGetCrtcInfo(display, resources, resources->crtcs[i]));
+        if(!info)
+            continue;
+        if(info->mode != None && info->width > 0 && info->height > 0)
+            active.emplace_back(resources->crtcs[i], Rect<int>(info->x, info->y, info->width, info->height));
+        XRRFreeCrtcInfo(info);
+    }
+    XRRFreeScreenResources(resources);
+
+    // Drop outputs whose CRTC went away
+    for(size_t i = 0; i < outputs.size();) {
+        RRCrtc crtc = outputs[i].crtc;
+        bool still_active = crtc == None || any_of(active.begin(), active.end(),
+                [crtc](const pair<RRCrtc, Rect<int>>& a) { return a.first == crtc; });
+        if(still_active) {
+            ++i;
+        } else {
+            RemoveOutput(crtc, changed);
+        }
+    }
+
+    // Add or update the rest
+    for(const auto& a : active)
+        UpdateOutput(display, root, a.first, a.second, changed);
+}
+
+void OutputTable::EnsureOutput(Display *display, Window root, vector<Rect<int>>& changed) {
+    if(!outputs.empty())
+        return;
+
+    // No XRandR or no active CRTC, use the whole root window
+    Window returned_root;
+    int x_root, y_root;
+    unsigned width_root, height_root, border_width_root, depth_root;
+    TRACE_CALL("XGetGeometry", XGetGeometry(display, root, &returned_root, &x_root, &y_root, &width_root, &height_root, &border_width_root, &depth_root));
+
+    Output output;
+    output.crtc = None;
+    output.rect = Rect<int>(0, 0, width_root, height_root);
+    output.bar.Create(display, root, output.rect);
+    changed.push_back(output.rect);
+    outputs.push_back(move(output));
+}
+
+Output& OutputTable::OutputAt(int x, int y) {
+    Output *closest = &outputs.front();
+    long closest_distance = LONG_MAX;
+    for(Output& output : outputs) {
+        if(output.rect.Contains(x, y))
+            return output;
+
+        // Distance from the point to the output rectangle
+        long dx = max(0, max(output.rect.x - x, x - (output.rect.x + output.rect.width - 1)));
+        long dy = max(0, max(output.rect.y - y, y - (output.rect.y + output.rect.height - 1)));
+        long distance = dx*dx + dy*dy;
+        if(distance < closest_distance) {
+            closest_distance = distance;
+            closest = &output;
+        }
+    }
+    return *closest;
+}
+
+Output& OutputTable::OutputAt(const Rect<int>& rect) {
+    return OutputAt(rect.x + rect.width/2, rect.y + rect.height/2);
+}
+
+Position<int> OutputTable::Clamp(const Rect<int>& outer) {
+    const Rect<int> area = OutputAt(outer).WorkArea();
+
+    // Right/bottom edges first so a frame larger than the area stays anchored at the top left
+    int x = max(area.x, min(outer.x, area.x + area.width - outer.width));
+    int y = max(area.y, min(outer.y, area.y + area.height - outer.height));
+    return Position<int>(x, y);
+}
+
+Output* OutputTable::FindBar(Window win) {
+    for(Output& output : outputs) {
+        if(output.bar.bar_win == win)
+            return &output;
+    }
+    return nullptr;
+}
@@ -0,0 +1,77 @@
+#ifndef OUTPUT_HPP
+#define OUTPUT_HPP
+
+extern "C" {
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+}
+#include <vector>
+#include "util.hpp"
+#include "bar.hpp"
+#include "layout.hpp"
+
+// A monitor, driven by one XRandR CRTC
+struct Output {
+    // CRTC driving the output, None if XRandR is not available
+    RRCrtc crtc;
+
+    // Area covered by the output in root coordinates
+    Rect<int> rect;
+
+    // Bar along the bottom of the output
+    Bar bar;
+
+    // How frames on this output are arranged
+    Layout layout = Layout::Floating;
+
+    // Area available to frames (the output without the bar strip)
+    Rect<int> WorkArea() const;
+};
+
+// Cached table of the active outputs. It is queried from XRandR once in Create() and then
+// updated incrementally from RRScreenChangeNotify/RRCrtcChangeNotify
+class OutputTable {
+    public:
+        // Query the outputs and create a bar on each of them
+        void Create(Display *display, Window root);
+
+        // Apply a XRandR event to the table. Returns false if e is not a XRandR event.
+        // The old and new areas of every output that was added, removed or changed are appended to changed
+        bool HandleEvent(Display *display, Window root, XEvent& e, ::std::vector<Rect<int>>& changed);
+
+        // Output containing the point, or the closest one if the point is not on any output
+        Output& OutputAt(int x, int y);
+
+        // Output the center of rect is on
+        Output& OutputAt(const Rect<int>& rect);
+
+        // Position that keeps a frame's outer rectangle inside the work area of its output
+        Position<int> Clamp(const Rect<int>& outer);
+
+        // Output whose bar window is win, nullptr if win is not a bar
+        Output* FindBar(Window win);
+
+        ::std::vector<Output> outputs;
+
+    private:
+
+        // Add, move or resize the output driven by crtc
+        void UpdateOutput(Display *display, Window root, RRCrtc crtc, const Rect<int>& rect, ::std::vector<Rect<int>>& changed);
+
+        // Remove the output driven by crtc
+        void RemoveOutput(RRCrtc crtc, ::std::vector<Rect<int>>& changed);
+
+        // Query the CRTCs again and apply only the differences to the table
+        void Refresh(Display *display, Window root, ::std::vector<Rect<int>>& changed);
+
+        // Make sure there is always at least one output covering the root window
+        void EnsureOutput(Display *display, Window root, ::std::vector<Rect<int>>& changed);
+
+        // Whether the XRandR extension is available
+        bool randr_ = false;
+
+        // First XRandR event code
+        int event_base_ = 0;
+};
+
+#endif
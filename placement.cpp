@@ -0,0 +1,140 @@
+#include "placement.hpp"
+#include "frame.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// Segment tree over elementary y intervals that counts how many frames cover each interval.
+// Every removal matches an earlier addition, so the additions are never pushed down
+class CoverTree {
+    public:
+        explicit CoverTree(int leaves) : leaves_(leaves), min_(4*leaves, 0), add_(4*leaves, 0) {}
+
+        // Add delta to the cover count of intervals [first, last)
+        void Add(int first, int last, int delta) {
+            Add(1, 0, leaves_, first, last, delta);
+        }
+
+        // First interval that no frame covers, -1 if all are covered
+        int FirstUncovered() const {
+            if(min_[1] > 0)
+                return -1;
+
+            // Along a path of zero minimums all additions are zero
+            int node = 1, lo = 0, hi = leaves_;
+            while(hi - lo > 1) {
+                int mid = (lo + hi) / 2;
+                if(min_[2*node] == 0) {
+                    node = 2*node;
+                    hi = mid;
+                } else {
+                    node = 2*node + 1;
+                    lo = mid;
+                }
+            }
+            return lo;
+        }
+
+    private:
+        void Add(int node, int lo, int hi, int first, int last, int delta) {
+            if(last <= lo || hi <= first)
+                return;
+            if(first <= lo && hi <= last) {
+                add_[node] += delta;
+                min_[node] += delta;
+                return;
+            }
+            int mid = (lo + hi) / 2;
+            Add(2*node, lo, mid, first, last, delta);
+            Add(2*node + 1, mid, hi, first, last, delta);
+            min_[node] = add_[node] + min(min_[2*node], min_[2*node + 1]);
+        }
+
+        int leaves_;
+        vector<int> min_;
+        vector<int> add_;
+};
+
+struct SweepEvent {
+    int x;
+    int first, last;
+    int delta;
+};
+
+}
+
+bool FindFreePosition(const Rect<int>& area, const vector<Rect<int>>& frames, const Size<int>& size, Position<int>& result) {
+    // Valid top left corners form the half-open box [x_begin, x_end) x [y_begin, y_end)
+    const int x_begin = area.x, x_end = area.x + area.width - size.width + 1;
+    const int y_begin = area.y, y_end = area.y + area.height - size.height + 1;
+    if(x_end <= x_begin || y_end <= y_begin)
+        return false;
+
+    // A frame blocks every corner that would make the new frame overlap it,
+    // which is the frame grown up and to the left by the new frame's size
+    vector<Rect<int>> blocked;
+    vector<int> ys = { y_begin, y_end };
+    blocked.reserve(frames.size());
+    ys.reserve(2*frames.size() + 2);
+    for(const Rect<int>& frame : frames) {
+        int x0 = max(x_begin, frame.x - size.width + 1), x1 = min(x_end, frame.x + frame.width);
+        int y0 = max(y_begin, frame.y - size.height + 1), y1 = min(y_end, frame.y + frame.height);
+        if(x0 >= x1 || y0 >= y1)
+            continue;
+        blocked.emplace_back(x0, y0, x1 - x0, y1 - y0);
+        ys.push_back(y0);
+        ys.push_back(y1);
+    }
+
+    // Compress the y coordinates into elementary intervals
+    sort(ys.begin(), ys.end());
+    ys.erase(unique(ys.begin(), ys.end()), ys.end());
+    auto y_index = [&ys](int y) { return int(lower_bound(ys.begin(), ys.end(), y) - ys.begin()); };
+
+    // Coverage only changes where a blocked region starts or ends. It can only drop to zero at the
+    // left edge of the area or where a blocked region ends, so those are the only columns to test
+    vector<SweepEvent> events;
+    vector<int> columns = { x_begin };
+    events.reserve(2*blocked.size());
+    columns.reserve(blocked.size() + 1);
+    for(const Rect<int>& b : blocked) {
+        int first = y_index(b.y), last = y_index(b.y + b.height);
+        events.push_back({ b.x, first, last, 1 });
+        events.push_back({ b.x + b.width, first, last, -1 });
+        if(b.x + b.width < x_end)
+            columns.push_back(b.x + b.width);
+    }
+    sort(events.begin(), events.end(), [](const SweepEvent& a, const SweepEvent& b) { return a.x < b.x; });
+    sort(columns.begin(), columns.end());
+    columns.erase(unique(columns.begin(), columns.end()), columns.end());
+
+    CoverTree tree(ys.size() - 1);
+    size_t next_event = 0;
+    for(int x : columns) {
+        while(next_event < events.size() && events[next_event].x <= x) {
+            const SweepEvent& ev = events[next_event++];
+            tree.Add(ev.first, ev.last, ev.delta);
+        }
+
+        int free_interval = tree.FirstUncovered();
+        if(free_interval >= 0) {
+            result = Position<int>(x, ys[free_interval]);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+Position<int> CascadePosition(const Rect<int>& area, const Size<int>& size, int n) {
+    // Step by one titlebar so every title stays visible
+    const int step = CLIENT_OFFSET_Y + 2*BUTTON_PADDING;
+    const int steps_x = max(1, (area.width - size.width) / step + 1);
+    const int steps_y = max(1, (area.height - size.height) / step + 1);
+    const int i = n % min(steps_x, steps_y);
+    return Position<int>(area.x + i*step, area.y + i*step);
+}
@@ -0,0 +1,15 @@
+#ifndef PLACEMENT_HPP
+#define PLACEMENT_HPP
+
+#include <vector>
+#include "util.hpp"
+
+// Find the top-left-most position inside area where a frame with the given outer size
+// overlaps none of the frames. Returns false if there is no such position.
+// Sweep line over x with a segment tree over the y coordinates, O(n log n) in the number of frames
+bool FindFreePosition(const Rect<int>& area, const ::std::vector<Rect<int>>& frames, const Size<int>& size, Position<int>& result);
+
+// Position of the n-th frame in a cascade starting at the top left corner of area
+Position<int> CascadePosition(const Rect<int>& area, const Size<int>& size, int n);
+
+#endif
@@ -0,0 +1,52 @@
+// Times FindFreePosition on an output with a growing number of frames. Build and run with make bench-placement.
+// Exits with 1 if the median placement among BENCH_LIMITED_FRAMES frames takes BENCH_LIMIT_US or longer
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "placement.hpp"
+
+using namespace std;
+
+// Placements timed per frame count
+#define BENCH_ITERATIONS 200
+
+// Budget for placing a window among this many others
+#define BENCH_LIMITED_FRAMES 500
+#define BENCH_LIMIT_US 1000.0
+
+int main() {
+    const Rect<int> area(0, 0, 3840, 2130);
+    const Size<int> size(640, 480);
+    mt19937 random(1);
+    bool failed = false;
+
+    for(int count : { 10, 100, 500, 1000, 10000 }) {
+        // Small frames scattered over the output, so a free spot usually still exists
+        uniform_int_distribution<int> x(area.x, area.x + area.width - 1), y(area.y, area.y + area.height - 1);
+        uniform_int_distribution<int> extent(20, 120);
+        vector<Rect<int>> frames;
+        for(int i = 0; i < count; ++i) {
+            frames.emplace_back(x(random), y(random), extent(random), extent(random));
+        }
+
+        int found = 0;
+        Position<int> pos;
+        vector<double> times;
+        for(int i = 0; i < BENCH_ITERATIONS; ++i) {
+            auto start = chrono::steady_clock::now();
+            found += FindFreePosition(area, frames, size, pos);
+            times.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+        }
+        nth_element(times.begin(), times.begin() + times.size()/2, times.end());
+        const double median = times[times.size()/2];
+
+        const bool over = count == BENCH_LIMITED_FRAMES && median >= BENCH_LIMIT_US;
+        failed = failed || over;
+        printf("%6d frames: %10.2f us median per placement (%s)%s\n", count, median, found ? "found" : "full",
+                over ? "  FAIL" : "");
+    }
+    return failed ? 1 : 0;
+}
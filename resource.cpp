@@ -0,0 +1,23 @@
+#include "resource.hpp"
+#include <atomic>
+
+namespace resource_detail {
+::std::atomic<long> live[RESOURCE_TYPES];
+}
+
+ResourceCounts LiveResources() {
+    ResourceCounts counts;
+    for(int i = 0; i < RESOURCE_TYPES; ++i)
+        counts.count[i] = resource_detail::live[i].load();
+    return counts;
+}
+
+const char* ResourceName(ResourceType type) {
+    switch(type) {
+        case RESOURCE_PIXMAP: return "pixmap";
+        case RESOURCE_WINDOW: return "window";
+        case RESOURCE_CURSOR: return "cursor";
+        case RESOURCE_GC: return "gc";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef RESOURCE_HPP
+#define RESOURCE_HPP
+
+extern "C" {
+#include <X11/Xlib.h>
+}
+#include <atomic>
+
+// Kinds of X server resources the WM creates
+enum ResourceType {
+    RESOURCE_PIXMAP,
+    RESOURCE_WINDOW,
+    RESOURCE_CURSOR,
+    RESOURCE_GC,
+    RESOURCE_TYPES,
+};
+
+// Number of resources of each type, either live in the whole WM or owned by one object
+struct ResourceCounts {
+    long count[RESOURCE_TYPES] = {};
+
+    ResourceCounts& operator+=(const ResourceCounts& other) {
+        for(int i = 0; i < RESOURCE_TYPES; ++i)
+            count[i] += other.count[i];
+        return *this;
+    }
+};
+
+// Resources currently alive, kept up to date by XResource
+ResourceCounts LiveResources();
+
+// Name of a resource type, for printing
+const char* ResourceName(ResourceType type);
+
+namespace resource_detail {
+extern ::std::atomic<long> live[RESOURCE_TYPES];
+}
+
+// Owns one X server resource and frees it when it goes out of scope or is replaced.
+// Converts to the plain handle, so it can be passed straight to Xlib
+template <typename Handle, ResourceType Type, int (*Free)(Display*, Handle)>
+class XResource {
+    public:
+        XResource() = default;
+
+        XResource(Display *display, Handle handle) {
+            reset(display, handle);
+        }
+
+        ~XResource() {
+            reset();
+        }
+
+        XResource(const XResource&) = delete;
+        XResource& operator=(const XResource&) = delete;
+
+        XResource(XResource&& other) : display_(other.display_), handle_(other.handle_) {
+            other.handle_ = Handle();
+        }
+
+        XResource& operator=(XResource&& other) {
+            if(this != &other) {
+                reset();
+                display_ = other.display_;
+                handle_ = other.handle_;
+                other.handle_ = Handle();
+            }
+            return *this;
+        }
+
+        // Free the current resource and take ownership of handle
+        void reset(Display *display = nullptr, Handle handle = Handle()) {
+            if(handle_) {
+                Free(display_, handle_);
+                --resource_detail::live[Type];
+            }
+            display_ = display;
+            handle_ = handle;
+            if(handle_)
+                ++resource_detail::live[Type];
+        }
+
+        // Give up ownership without freeing
+        Handle release() {
+            Handle handle = handle_;
+            if(handle_)
+                --resource_detail::live[Type];
+            handle_ = Handle();
+            return handle;
+        }
+
+        Handle get() const {
+            return handle_;
+        }
+
+        operator Handle() const {
+            return handle_;
+        }
+
+        // Adds this resource to counts if it is held
+        void Count(ResourceCounts& counts) const {
+            if(handle_)
+                ++counts.count[Type];
+        }
+
+    private:
+        Display *display_ = nullptr;
+        Handle handle_ = Handle();
+};
+
+typedef XResource<Pixmap, RESOURCE_PIXMAP, XFreePixmap> OwnedPixmap;
+typedef XResource<Window, RESOURCE_WINDOW, XDestroyWindow> OwnedWindow;
+typedef XResource<Cursor, RESOURCE_CURSOR, XFreeCursor> OwnedCursor;
+typedef XResource<GC, RESOURCE_GC, XFreeGC> OwnedGC;
+
+#endif
@@ -0,0 +1,208 @@
+#include "scale.hpp"
+#include <cstdint>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+#ifdef __SSE2__
+
+// Premultiply two pixels unpacked to 16-bit lanes [B G R A B G R A]
+inline __m128i Premultiply16(__m128i px) {
+    const __m128i alpha_mask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+
+    // x*a/255, rounded: (t + (t >> 8)) >> 8 with t = x*a + 128
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(px, alpha), _mm_set1_epi16(128));
+    t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+
+    // Alpha itself stays as it was
+    return _mm_or_si128(_mm_andnot_si128(alpha_mask, t), _mm_and_si128(alpha_mask, px));
+}
+
+// Sum of the premultiplied channels of a block of pixels, as 32-bit lanes [B G R A]
+inline __m128i SumBlock(const uint32_t *src, int stride, int x0, int x1, int y0, int y1) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    for(int y = y0; y < y1; ++y) {
+        const uint32_t *row = src + y*stride;
+        int x = x0;
+        for(; x + 4 <= x1; x += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+            __m128i lo = Premultiply16(_mm_unpacklo_epi8(v, zero));
+            __m128i hi = Premultiply16(_mm_unpackhi_epi8(v, zero));
+            __m128i sum = _mm_add_epi16(lo, hi);
+            acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_unpacklo_epi16(sum, zero), _mm_unpackhi_epi16(sum, zero)));
+        }
+        for(; x < x1; ++x) {
+            __m128i px = Premultiply16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(row[x]), zero));
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(px, zero));
+        }
+    }
+    return acc;
+}
+
+// Blend 4 pixels of a and b with weight w/128 of b
+inline __m128i Lerp4(__m128i a, __m128i b, __m128i wa, __m128i wb) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi16(64);
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), wa), _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), wb));
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), wa), _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), wb));
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, half), 7);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, half), 7);
+    return _mm_packus_epi16(lo, hi);
+}
+
+// Blend two neighbouring pixels with weight w/128 of the right one
+inline uint32_t Lerp2(uint32_t left, uint32_t right, int w) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i px = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(left), _mm_cvtsi32_si128(right)), zero);
+    __m128i weights = _mm_set_epi16(w, w, w, w, 128 - w, 128 - w, 128 - w, 128 - w);
+    px = _mm_mullo_epi16(px, weights);
+    px = _mm_add_epi16(px, _mm_srli_si128(px, 8));
+    px = _mm_srli_epi16(_mm_add_epi16(px, _mm_set1_epi16(64)), 7);
+    return _mm_cvtsi128_si32(_mm_packus_epi16(px, zero));
+}
+
+#else
+
+// Blend two pixels channel by channel with weight w/128 of b
+inline uint32_t Lerp(uint32_t a, uint32_t b, int w) {
+    uint32_t out = 0;
+    for(int shift = 0; shift < 32; shift += 8) {
+        uint32_t c = (((a >> shift) & 0xff)*(128 - w) + ((b >> shift) & 0xff)*w + 64) >> 7;
+        out |= c << shift;
+    }
+    return out;
+}
+
+inline uint32_t PremultiplyChannel(uint32_t c, uint32_t a) {
+    uint32_t t = c*a + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+#endif
+
+}
+
+void DownscalePremultiplied(const uint32_t *src, int src_width, int src_height,
+        uint32_t *dst, int dst_width, int dst_height) {
+    for(int dy = 0; dy < dst_height; ++dy) {
+        // Source rows covered by this destination row, at least one
+        int y0 = dy*src_height / dst_height;
+        int y1 = (dy + 1)*src_height / dst_height;
+        if(y1 <= y0)
+            y1 = y0 + 1;
+
+        for(int dx = 0; dx < dst_width; ++dx) {
+            int x0 = dx*src_width / dst_width;
+            int x1 = (dx + 1)*src_width / dst_width;
+            if(x1 <= x0)
+                x1 = x0 + 1;
+
+            const uint32_t count = (x1 - x0)*(y1 - y0);
+            uint32_t sum[4];
+#ifdef __SSE2__
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(sum), SumBlock(src, src_width, x0, x1, y0, y1));
+#else
+            sum[0] = sum[1] = sum[2] = sum[3] = 0;
+            for(int y = y0; y < y1; ++y) {
+                for(int x = x0; x < x1; ++x) {
+                    uint32_t px = src[y*src_width + x];
+                    uint32_t a = px >> 24;
+                    sum[0] += PremultiplyChannel(px & 0xff, a);
+                    sum[1] += PremultiplyChannel((px >> 8) & 0xff, a);
+                    sum[2] += PremultiplyChannel((px >> 16) & 0xff, a);
+                    sum[3] += a;
+                }
+            }
+#endif
+            uint32_t out = 0;
+            for(int c = 0; c < 4; ++c) {
+                out |= ((sum[c] + count/2) / count) << (8*c);
+            }
+            dst[dy*dst_width + dx] = out;
+        }
+    }
+}
+
+// Source position of a destination pixel center in 16.16 fixed point, split into the left
+// sample and a 7-bit weight of the right one. Edges are clamped
+static void BilinearTaps(int src_length, int dst_length, ::std::vector<int>& index, ::std::vector<int>& weight) {
+    index.resize(dst_length);
+    weight.resize(dst_length);
+    const int64_t step = (int64_t(src_length) << 16) / dst_length;
+    for(int d = 0; d < dst_length; ++d) {
+        int64_t pos = step*d + step/2 - (1 << 15);
+        if(pos < 0)
+            pos = 0;
+        int i = int(pos >> 16);
+        int w = int((pos >> 9) & 127);
+        if(i >= src_length - 1) {
+            i = src_length - 1;
+            w = 0;
+        }
+        index[d] = i;
+        weight[d] = w;
+    }
+}
+
+void ResampleBilinear(const uint32_t *src, int src_stride, int src_width, int src_height,
+        uint32_t *dst, int dst_width, int dst_height) {
+    ::std::vector<int> x_index, x_weight, y_index, y_weight;
+    BilinearTaps(src_width, dst_width, x_index, x_weight);
+    BilinearTaps(src_height, dst_height, y_index, y_weight);
+
+    // One source row blended vertically, then sampled horizontally. The extra pixel keeps the
+    // right tap of the last column in bounds
+    ::std::vector<uint32_t> row(src_width + 1);
+    for(int dy = 0; dy < dst_height; ++dy) {
+        const uint32_t *top = src + int64_t(y_index[dy])*src_stride;
+        const uint32_t *bottom = y_index[dy] + 1 < src_height ? top + src_stride : top;
+        const int wy = y_weight[dy];
+
+        int x = 0;
+#ifdef __SSE2__
+        const __m128i wa = _mm_set1_epi16(128 - wy);
+        const __m128i wb = _mm_set1_epi16(wy);
+        for(; x + 4 <= src_width; x += 4) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top + x));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + x));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(row.data() + x), Lerp4(a, b, wa, wb));
+        }
+        for(; x < src_width; ++x) {
+            row[x] = _mm_cvtsi128_si32(Lerp4(_mm_cvtsi32_si128(top[x]), _mm_cvtsi32_si128(bottom[x]), wa, wb));
+        }
+#else
+        for(; x < src_width; ++x) {
+            row[x] = Lerp(top[x], bottom[x], wy);
+        }
+#endif
+        row[src_width] = row[src_width - 1];
+
+        uint32_t *out = dst + int64_t(dy)*dst_width;
+        for(int dx = 0; dx < dst_width; ++dx) {
+            const int i = x_index[dx];
+#ifdef __SSE2__
+            out[dx] = Lerp2(row[i], row[i + 1], x_weight[dx]);
+#else
+            out[dx] = Lerp(row[i], row[i + 1], x_weight[dx]);
+#endif
+        }
+    }
+}
+
+void BlendOver(uint32_t *pixels, int count, uint32_t background) {
+    for(int i = 0; i < count; ++i) {
+        uint32_t px = pixels[i];
+        uint32_t inverse_alpha = 255 - (px >> 24);
+        uint32_t out = 0xff000000;
+        for(int shift = 0; shift < 24; shift += 8) {
+            uint32_t c = ((px >> shift) & 0xff) + (((background >> shift) & 0xff)*inverse_alpha + 127) / 255;
+            out |= (c > 255 ? 255 : c) << shift;
+        }
+        pixels[i] = out;
+    }
+}
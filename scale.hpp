@@ -0,0 +1,22 @@
+#ifndef SCALE_HPP
+#define SCALE_HPP
+
+#include <cstdint>
+
+// Pixels are 32-bit 0xAARRGGBB in native byte order, the format of _NET_WM_ICON and of 24/32-bit TrueColor XImages
+
+// Box filter src down to dst_width x dst_height, premultiplying alpha on the way.
+// Uses SSE2 when it is available. Also works for upscaling, as nearest neighbour
+void DownscalePremultiplied(const uint32_t *src, int src_width, int src_height,
+        uint32_t *dst, int dst_width, int dst_height);
+
+// Bilinear resample of a src_width x src_height region of src, whose rows are src_stride pixels apart,
+// to dst_width x dst_height. Meant for opaque images that are scaled by less than 2x, like wallpapers.
+// Uses SSE2 when it is available, with the same results as without
+void ResampleBilinear(const uint32_t *src, int src_stride, int src_width, int src_height,
+        uint32_t *dst, int dst_width, int dst_height);
+
+// Composite premultiplied pixels over an opaque background color, leaving them opaque
+void BlendOver(uint32_t *pixels, int count, uint32_t background);
+
+#endif
@@ -0,0 +1,63 @@
+#include "shape.hpp"
+extern "C" {
+#include <X11/Xutil.h>
+#include <X11/extensions/shape.h>
+}
+#include <cmath>
+#include <unordered_map>
+#include "trace.hpp"
+
+using namespace std;
+
+// Height of the band below the corners. The bounding shape is clipped to the window, so it
+// only needs to reach past the bottom of any frame and the shape doesn't change with the height
+#define SHAPE_BODY_HEIGHT 32767
+
+bool CornerShape::Supported(Display *display) {
+    int event_base, error_base;
+    return TRACE_CALL("XShapeQueryExtension", XShapeQueryExtension(display, &event_base, &error_base));
+}
+
+const vector<CornerShape::Band>& CornerShape::Bands(int radius) {
+    // Only a handful of radii are ever used, one per theme
+    static unordered_map<int, vector<Band>> cache;
+    auto found = cache.find(radius);
+    if(found != cache.end())
+        return found->second;
+
+    vector<Band>& bands = cache[radius];
+    for(int y = 0; y < radius; y++) {
+        // Horizontal distance from the corner to the circle, sampled at the middle of the row
+        double dy = radius - y - 0.5;
+        short inset = short(lround(radius - sqrt(double(radius)*radius - dy*dy)));
+        if(!bands.empty() && bands.back().inset == inset) {
+            bands.back().height++;
+        } else {
+            bands.push_back(Band{short(y), 1, inset});
+        }
+    }
+    return bands;
+}
+
+void CornerShape::Apply(Display *display, Window win, int border, int outer_width, int radius) {
+    const vector<Band>& bands = Bands(radius);
+
+    // One rectangle per band and one for the rest of the frame, in YX-banded order.
+    // Reused between calls, so resizing allocates nothing
+    static vector<XRectangle> rects;
+    rects.clear();
+    for(const Band& band : bands) {
+        int width = outer_width - 2*band.inset;
+        if(width <= 0)
+            continue;
+        rects.push_back(XRectangle{band.inset, band.y, (unsigned short)width, (unsigned short)band.height});
+    }
+    rects.push_back(XRectangle{0, short(radius), (unsigned short)outer_width, SHAPE_BODY_HEIGHT});
+
+    // The bounding region includes the border, which starts at -border
+    XShapeCombineRectangles(display, win, ShapeBounding, -border, -border, rects.data(), rects.size(), ShapeSet, YXBanded);
+}
+
+void CornerShape::Clear(Display *display, Window win) {
+    XShapeCombineMask(display, win, ShapeBounding, 0, 0, None, ShapeSet);
+}
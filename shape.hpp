@@ -0,0 +1,36 @@
+#ifndef SHAPE_HPP
+#define SHAPE_HPP
+
+extern "C" {
+#include <X11/Xlib.h>
+}
+#include <vector>
+
+// Radius (in pixels) of the rounded top corners of frames, measured on the outer edge of the border
+#define FRAME_CORNER_RADIUS 8
+
+// Bounding shape of a frame with rounded top corners. The corner rows only depend on the radius,
+// so they are computed once per radius and a resize only fills in the widths of those few rectangles
+// and sends them with XShapeCombineRectangles, instead of drawing a mask the size of the frame
+class CornerShape {
+    public:
+        // Whether the server has the SHAPE extension. Without it frames stay square
+        static bool Supported(Display *display);
+
+        // Round the top corners of win, whose outer width (including border) is outer_width
+        static void Apply(Display *display, Window win, int border, int outer_width, int radius);
+
+        // Give win back its plain rectangular shape
+        static void Clear(Display *display, Window win);
+
+    private:
+        // Rows of a corner that share the same inset, from the top
+        struct Band {
+            short y, height, inset;
+        };
+
+        // Bands for radius, built on first use
+        static const ::std::vector<Band>& Bands(int radius);
+};
+
+#endif
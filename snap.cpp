@@ -0,0 +1,121 @@
+#include "snap.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+void SortEdges(vector<int>& edges) {
+    sort(edges.begin(), edges.end());
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+}
+
+}
+
+void SnapEdges::Build(const vector<Rect<int>>& frames, const vector<Rect<int>>& areas) {
+    Clear();
+
+    frame_x_.reserve(2*frames.size());
+    frame_y_.reserve(2*frames.size());
+    for(const Rect<int>& r : frames) {
+        frame_x_.push_back(Edge{ r.x, r.y, r.y + r.height });
+        frame_x_.push_back(Edge{ r.x + r.width, r.y, r.y + r.height });
+        frame_y_.push_back(Edge{ r.y, r.x, r.x + r.width });
+        frame_y_.push_back(Edge{ r.y + r.height, r.x, r.x + r.width });
+    }
+
+    for(const Rect<int>& r : areas) {
+        area_left_.push_back(r.x);
+        area_right_.push_back(r.x + r.width);
+        area_top_.push_back(r.y);
+        area_bottom_.push_back(r.y + r.height);
+    }
+
+    MergeEdges(frame_x_);
+    MergeEdges(frame_y_);
+    SortEdges(area_left_);
+    SortEdges(area_right_);
+    SortEdges(area_top_);
+    SortEdges(area_bottom_);
+}
+
+void SnapEdges::MergeEdges(vector<Edge>& edges) {
+    sort(edges.begin(), edges.end());
+    size_t out = 0;
+    for(size_t i = 0; i < edges.size(); ++i) {
+        if(out > 0 && edges[out - 1].at == edges[i].at && edges[i].from <= edges[out - 1].to) {
+            edges[out - 1].to = max(edges[out - 1].to, edges[i].to);
+        } else {
+            edges[out++] = edges[i];
+        }
+    }
+    edges.resize(out);
+}
+
+void SnapEdges::Clear() {
+    frame_x_.clear();
+    frame_y_.clear();
+    area_left_.clear();
+    area_right_.clear();
+    area_top_.clear();
+    area_bottom_.clear();
+}
+
+void SnapEdges::Nearest(const vector<int>& edges, int side, int max_distance, int& best, bool& found) {
+    // Only the edges right before and after side can be the nearest
+    auto it = lower_bound(edges.begin(), edges.end(), side);
+    if(it != edges.end() && *it - side <= max_distance && (!found || *it - side < abs(best))) {
+        best = *it - side;
+        found = true;
+    }
+    if(it != edges.begin() && side - *(it - 1) <= max_distance && (!found || side - *(it - 1) < abs(best))) {
+        best = *(it - 1) - side;
+        found = true;
+    }
+}
+
+void SnapEdges::NearestEdge(const vector<Edge>& edges, int side, int cross_start, int cross_end, int& best, bool& found) {
+    auto before_at = [](const Edge& e, int at) { return e.at < at; };
+    auto before_end = [](const Edge& e, const Edge& key) { return e.at < key.at || (e.at == key.at && e.to < key.to); };
+
+    // One binary search per position within SNAP_DISTANCE of side, so at most 2*SNAP_DISTANCE + 1 of them
+    auto it = lower_bound(edges.begin(), edges.end(), side - SNAP_DISTANCE, before_at);
+    while(it != edges.end() && it->at <= side + SNAP_DISTANCE) {
+        const int at = it->at;
+
+        // The spans at one position are disjoint and sorted, so only the first one that doesn't end before the
+        // frame can reach it. An edge far off along the other axis, e.g. of a window in another row, isn't a target
+        auto span = lower_bound(it, edges.end(), Edge{ at, 0, cross_start - SNAP_DISTANCE }, before_end);
+        if(span != edges.end() && span->at == at && span->from <= cross_end + SNAP_DISTANCE
+                && (!found || abs(at - side) < abs(best))) {
+            best = at - side;
+            found = true;
+        }
+        it = lower_bound(span, edges.end(), at + 1, before_at);
+    }
+}
+
+int SnapEdges::SnapAxis(const vector<Edge>& frame_edges, const vector<int>& area_starts,
+        const vector<int>& area_ends, int start, int length, int cross_start, int cross_length) {
+    int offset = 0;
+    bool found = false;
+
+    // Either side of the frame snaps to either side of another frame next to it
+    NearestEdge(frame_edges, start, cross_start, cross_start + cross_length, offset, found);
+    NearestEdge(frame_edges, start + length, cross_start, cross_start + cross_length, offset, found);
+    if(found)
+        return start + offset;
+
+    Nearest(area_starts, start, EDGE_RESISTANCE, offset, found);
+    Nearest(area_ends, start + length, EDGE_RESISTANCE, offset, found);
+    return start + offset;
+}
+
+Position<int> SnapEdges::Snap(const Rect<int>& outer) const {
+    return Position<int>(SnapAxis(frame_x_, area_left_, area_right_, outer.x, outer.width, outer.y, outer.height),
+            SnapAxis(frame_y_, area_top_, area_bottom_, outer.y, outer.height, outer.x, outer.width));
+}
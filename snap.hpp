@@ -0,0 +1,61 @@
+#ifndef SNAP_HPP
+#define SNAP_HPP
+
+#include <vector>
+#include "util.hpp"
+
+// How close (in pixels) a dragged frame's edge has to get to another frame's edge to snap to it
+#define SNAP_DISTANCE 10
+
+// How far a dragged frame has to be pushed past the edge of a work area before it lets go
+#define EDGE_RESISTANCE 24
+
+// Edges a dragged frame snaps to. Built once when the drag starts and kept sorted,
+// so every motion event only does a binary search instead of scanning all frames
+class SnapEdges {
+    public:
+        // Collect the edges of the other frames and of the work areas of the outputs
+        void Build(const ::std::vector<Rect<int>>& frames, const ::std::vector<Rect<int>>& areas);
+
+        // Position for a frame dragged to outer, snapped to the nearest edges
+        Position<int> Snap(const Rect<int>& outer) const;
+
+        // Drop the edges at the end of a drag
+        void Clear();
+
+    private:
+        // Edges of other frames at a position on one axis, covering [from, to] on the other axis
+        struct Edge {
+            int at, from, to;
+
+            bool operator<(const Edge& other) const {
+                return at < other.at || (at == other.at && from < other.from);
+            }
+        };
+
+        // Sort edges and merge the overlapping spans at each position, so the spans at one position are
+        // disjoint and both their starts and ends are increasing
+        static void MergeEdges(::std::vector<Edge>& edges);
+
+        // Offset that moves side onto the nearest of edges within max_distance, if it is closer than best.
+        // Sets found when it is
+        static void Nearest(const ::std::vector<int>& edges, int side, int max_distance, int& best, bool& found);
+
+        // Same for frame edges, but only those whose span comes within SNAP_DISTANCE of [cross_start, cross_end].
+        // O(SNAP_DISTANCE log n), however many frames are aligned on the same edge
+        static void NearestEdge(const ::std::vector<Edge>& edges, int side, int cross_start, int cross_end, int& best, bool& found);
+
+        // Snaps one axis, frame edges first and then work area edges. cross_start and cross_length are
+        // the frame's extent on the other axis
+        static int SnapAxis(const ::std::vector<Edge>& frame_edges, const ::std::vector<int>& area_starts,
+                const ::std::vector<int>& area_ends, int start, int length, int cross_start, int cross_length);
+
+        // Vertical and horizontal edges of other frames, merged and sorted by position
+        ::std::vector<Edge> frame_x_, frame_y_;
+
+        // Left/top and right/bottom edges of the work areas, which also resist being dragged across.
+        // Kept apart so a frame only snaps to the inside of an area
+        ::std::vector<int> area_left_, area_right_, area_top_, area_bottom_;
+};
+
+#endif
@@ -0,0 +1,156 @@
+#include "start_menu.hpp"
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include "bar.hpp"
+#include "trace.hpp"
+
+using namespace std;
+
+// Shown when there is nothing to launch
+#define MENU_EMPTY_TEXT "(No applications)"
+
+void StartMenu::Create(Display *display, Window root) {
+    int screen_num = DefaultScreen(display);
+    XSetWindowAttributes attrs;
+    attrs.override_redirect = True;
+    attrs.background_pixel = MENU_BG_COLOR;
+    attrs.border_pixel = MENU_BORDER_COLOR;
+    attrs.event_mask = LeaveWindowMask;
+    menu_win.reset(display, XCreateWindow(display, root, 0, 0, 1, 1, MENU_BORDER_WIDTH, DefaultDepth(display, screen_num),
+            InputOutput, DefaultVisual(display, screen_num), CWOverrideRedirect | CWBackPixel | CWBorderPixel | CWEventMask, &attrs));
+}
+
+void StartMenu::Prepare(Display *display, Window root, GlyphCache& glyphs, const Rect<int>& output_rect) {
+    const bool changed = index_.Refresh();
+
+    // As many rows as fit above the bar, and no more than there are items. The columns are cut off at
+    // the width of the output, the items that don't fit are left out
+    const int count = index_.size();
+    int rows = max(1, (output_rect.height - BAR_HEIGHT - 2*MENU_BORDER_WIDTH) / MENU_ITEM_HEIGHT);
+    rows = min(rows, max(1, count));
+    const int max_columns = max(1, (output_rect.width - 2*MENU_BORDER_WIDTH) / MENU_COLUMN_WIDTH);
+    const int columns = min(max_columns, max(1, (count + rows - 1) / rows));
+    if(changed || rows != rows_ || columns != columns_ || items_pix == None)
+        Render(display, root, glyphs, rows, columns);
+}
+
+void StartMenu::Render(Display *display, Window root, GlyphCache& glyphs, int rows, int columns) {
+    TRACE_SPAN("RenderStartMenu");
+    const int count = min<int>(index_.size(), rows*columns);
+    rows_ = rows;
+    columns_ = columns;
+    const int width = columns_*MENU_COLUMN_WIDTH;
+    const int height = rows_*MENU_ITEM_HEIGHT;
+
+    int screen_num = DefaultScreen(display);
+    const int depth = DefaultDepth(display, screen_num);
+    items_pix.reset(display, XCreatePixmap(display, root, width, height, depth));
+    hover_pix.reset(display, XCreatePixmap(display, root, width, height, depth));
+
+    XGCValues gc_values;
+    gc_values.foreground = MENU_BG_COLOR;
+    OwnedGC gc(display, XCreateGC(display, root, GCForeground, &gc_values));
+    XFillRectangle(display, items_pix, gc, 0, 0, width, height);
+    XSetForeground(display, gc, MENU_HOVER_COLOR);
+    XFillRectangle(display, hover_pix, gc, 0, 0, width, height);
+    if(!glyphs.font)
+        return;
+
+    if(count == 0) {
+        glyphs.Draw(display, items_pix, MENU_EMPTY_TEXT, MENU_TEXT_PADDING, 0, MENU_ITEM_HEIGHT);
+        return;
+    }
+
+    // Column by column, in the order of the index
+    for(int i = 0; i < count; ++i) {
+        const Rect<int> item = ItemRect(i);
+        FittedText text = glyphs.Fit(display, index_.Name(i), MENU_COLUMN_WIDTH - 2*MENU_TEXT_PADDING);
+        for(Pixmap pix : { Pixmap(items_pix), Pixmap(hover_pix) }) {
+            glyphs.Draw(display, pix, text.text, item.x + MENU_TEXT_PADDING, item.y, MENU_ITEM_HEIGHT);
+        }
+    }
+}
+
+Rect<int> StartMenu::ItemRect(int item) const {
+    return Rect<int>((item / rows_)*MENU_COLUMN_WIDTH, (item % rows_)*MENU_ITEM_HEIGHT, MENU_COLUMN_WIDTH, MENU_ITEM_HEIGHT);
+}
+
+int StartMenu::ItemAt(int x_root, int y_root) const {
+    if(!open || !rect_.Contains(x_root, y_root))
+        return -1;
+    const int column = (x_root - rect_.x - MENU_BORDER_WIDTH) / MENU_COLUMN_WIDTH;
+    const int row = (y_root - rect_.y - MENU_BORDER_WIDTH) / MENU_ITEM_HEIGHT;
+    if(column < 0 || row < 0 || column >= columns_ || row >= rows_)
+        return -1;
+    const int item = column*rows_ + row;
+    return item < int(index_.size()) ? item : -1;
+}
+
+void StartMenu::Open(Display *display, Window root, GlyphCache& glyphs, const Rect<int>& output_rect) {
+    Prepare(display, root, glyphs, output_rect);
+
+    // Bottom left corner on top of the start button, and never larger than the output
+    const int width = max(1, min(columns_*MENU_COLUMN_WIDTH, output_rect.width - 2*MENU_BORDER_WIDTH));
+    const int height = max(1, min(rows_*MENU_ITEM_HEIGHT, output_rect.height - BAR_HEIGHT - 2*MENU_BORDER_WIDTH));
+    rect_ = Rect<int>(output_rect.x, output_rect.y + output_rect.height - BAR_HEIGHT - height - 2*MENU_BORDER_WIDTH,
+            width + 2*MENU_BORDER_WIDTH, height + 2*MENU_BORDER_WIDTH);
+    hovered_ = -1;
+
+    XMoveResizeWindow(display, menu_win, rect_.x, rect_.y, width, height);
+    XSetWindowBackgroundPixmap(display, menu_win, items_pix);
+    XMapRaised(display, menu_win);
+    XClearWindow(display, menu_win);
+    open = true;
+}
+
+void StartMenu::Close(Display *display) {
+    if(!open)
+        return;
+    XUnmapWindow(display, menu_win);
+    open = false;
+    hovered_ = -1;
+}
+
+void StartMenu::Hover(Display *display, int x_root, int y_root) {
+    const int item = ItemAt(x_root, y_root);
+    if(item == hovered_)
+        return;
+
+    // The old item is repainted from the window background, the new one copied from hover_pix
+    if(hovered_ >= 0) {
+        const Rect<int> old_rect = ItemRect(hovered_);
+        XClearArea(display, menu_win, old_rect.x, old_rect.y, old_rect.width, old_rect.height, False);
+    }
+    if(item >= 0) {
+        const Rect<int> new_rect = ItemRect(item);
+        XCopyArea(display, hover_pix, menu_win, DefaultGC(display, DefaultScreen(display)),
+                new_rect.x, new_rect.y, new_rect.width, new_rect.height, new_rect.x, new_rect.y);
+    }
+    hovered_ = item;
+}
+
+void StartMenu::Click(int x_root, int y_root) {
+    const int item = ItemAt(x_root, y_root);
+    if(item >= 0)
+        Launch(index_.Exec(item));
+}
+
+void StartMenu::Launch(const char *command) {
+    pid_t pid = fork();
+    if(pid == 0) {
+        // Fork again so the application is reparented to init and the WM never has to reap it
+        setsid();
+        if(fork() == 0) {
+            execl("/bin/sh", "sh", "-c", command, static_cast<char*>(nullptr));
+            _exit(127);
+        }
+        _exit(0);
+    }
+    if(pid > 0) {
+        waitpid(pid, nullptr, 0);
+    } else {
+        perror("fork");
+    }
+}
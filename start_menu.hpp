@@ -0,0 +1,73 @@
+#ifndef START_MENU_HPP
+#define START_MENU_HPP
+
+extern "C" {
+#include <X11/Xlib.h>
+}
+#include "util.hpp"
+#include "font.hpp"
+#include "resource.hpp"
+#include "app_index.hpp"
+
+#define MENU_COLUMN_WIDTH 220
+#define MENU_ITEM_HEIGHT 24
+#define MENU_TEXT_PADDING 8
+#define MENU_BORDER_WIDTH 1
+#define MENU_BG_COLOR 0x0054e3
+#define MENU_HOVER_COLOR 0x316ac5
+#define MENU_BORDER_COLOR 0x0000aa
+
+// Menu of the installed applications, opened from the start button. The items are read from the
+// AppIndex and rendered once into items_pix, which is the background of the menu window, so opening
+// the menu only maps the window. The highlighted item is copied from hover_pix, rendered alongside
+class StartMenu {
+    public:
+        // Create the menu window, unmapped
+        void Create(Display *display, Window root);
+
+        // Refresh the index and render the items for a menu that fits on output_rect, unless they are up to date
+        void Prepare(Display *display, Window root, GlyphCache& glyphs, const Rect<int>& output_rect);
+
+        // Show the menu above the start button of the bar on output_rect
+        void Open(Display *display, Window root, GlyphCache& glyphs, const Rect<int>& output_rect);
+
+        void Close(Display *display);
+
+        // Highlight the item at a root position, or nothing if it isn't on an item
+        void Hover(Display *display, int x_root, int y_root);
+
+        // Run the item at a root position, if there is one there
+        void Click(int x_root, int y_root);
+
+        bool open = false;
+
+        OwnedWindow menu_win;
+
+        // All items, and all items highlighted
+        OwnedPixmap items_pix, hover_pix;
+
+    private:
+        // Index of the item at a root position, -1 if there is none
+        int ItemAt(int x_root, int y_root) const;
+
+        // Item rectangle inside the menu window
+        Rect<int> ItemRect(int item) const;
+
+        // Render both pixmaps for the current index in a grid of rows by columns items
+        void Render(Display *display, Window root, GlyphCache& glyphs, int rows, int columns);
+
+        // Run command with sh -c, detached from the WM
+        static void Launch(const char *command);
+
+        AppIndex index_;
+
+        // Layout the pixmaps were rendered for, 0 rows before the first render
+        int rows_ = 0, columns_ = 0;
+
+        // Where the open menu is, in root coordinates
+        Rect<int> rect_;
+
+        int hovered_ = -1;
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include "trace.hpp"
+#include <unistd.h>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// One span. The fields are atomics so the exporter can read a ring while its thread keeps writing
+struct TraceEvent {
+    atomic<const char*> name;
+    atomic<uint64_t> start, end;
+};
+
+// Spans of one thread. Only that thread writes to it
+struct TraceRing {
+    atomic<uint64_t> head{0};
+    int tid;
+    atomic<const char*> thread_name{nullptr};
+    TraceEvent events[TRACE_RING_SIZE];
+};
+
+string trace_path;
+
+// Every ring ever created. Rings live as long as the process, so a thread that exits keeps its spans
+mutex rings_mutex;
+vector<TraceRing*> rings;
+
+thread_local TraceRing *thread_ring = nullptr;
+
+TraceRing* ThreadRing() {
+    if(!thread_ring) {
+        TraceRing *ring = new TraceRing;
+        lock_guard<mutex> lock(rings_mutex);
+        ring->tid = rings.size() + 1;
+        rings.push_back(ring);
+        thread_ring = ring;
+    }
+    return thread_ring;
+}
+
+// Names are literals, but may still need escaping
+void WriteEscaped(FILE *file, const char *s) {
+    for(; *s; ++s) {
+        if(*s == '"' || *s == '\\')
+            fputc('\\', file);
+        fputc(*s, file);
+    }
+}
+
+}
+
+namespace trace_detail {
+
+atomic<bool> enabled{false};
+
+uint64_t Now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
+
+void Record(const char *name, uint64_t start, uint64_t end) {
+    TraceRing *ring = ThreadRing();
+    const uint64_t head = ring->head.load(memory_order_relaxed);
+    TraceEvent& event = ring->events[head & (TRACE_RING_SIZE - 1)];
+    event.name.store(name, memory_order_relaxed);
+    event.start.store(start, memory_order_relaxed);
+    event.end.store(end, memory_order_relaxed);
+    // Publishes the span to the exporter
+    ring->head.store(head + 1, memory_order_release);
+}
+
+}
+
+void TraceStart(const char *path) {
+    trace_path = path;
+    trace_detail::enabled.store(true, memory_order_relaxed);
+    TraceThreadName("main");
+}
+
+void TraceThreadName(const char *name) {
+    if(trace_detail::enabled.load(memory_order_relaxed))
+        ThreadRing()->thread_name.store(name, memory_order_relaxed);
+}
+
+void TraceExport() {
+    if(!trace_detail::enabled.load(memory_order_relaxed))
+        return;
+
+    vector<TraceRing*> snapshot;
+    {
+        lock_guard<mutex> lock(rings_mutex);
+        snapshot = rings;
+    }
+
+    // Written next to the target and renamed, so a viewer never loads half a trace
+    const string tmp_path = trace_path + ".tmp";
+    FILE *file = fopen(tmp_path.c_str(), "w");
+    if(!file) {
+        perror("trace export");
+        return;
+    }
+
+    const int pid = getpid();
+    bool first = true;
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", file);
+    for(TraceRing *ring : snapshot) {
+        if(const char *thread_name = ring->thread_name.load(memory_order_relaxed)) {
+            fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"", first ? "" : ",", pid, ring->tid);
+            WriteEscaped(file, thread_name);
+            fputs("\"}}", file);
+            first = false;
+        }
+
+        // Spans between the two reads of head may have been overwritten while they were copied, those are dropped
+        const uint64_t head = ring->head.load(memory_order_acquire);
+        const uint64_t begin = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        vector<pair<const char*, pair<uint64_t, uint64_t>>> spans;
+        spans.reserve(head - begin);
+        for(uint64_t i = begin; i < head; ++i) {
+            const TraceEvent& event = ring->events[i & (TRACE_RING_SIZE - 1)];
+            spans.push_back({ event.name.load(memory_order_relaxed),
+                    { event.start.load(memory_order_relaxed), event.end.load(memory_order_relaxed) } });
+        }
+        const uint64_t head_after = ring->head.load(memory_order_acquire);
+        // The writer may be in the middle of span head_after, whose slot is that of head_after - TRACE_RING_SIZE
+        const uint64_t valid = head_after >= TRACE_RING_SIZE ? head_after - TRACE_RING_SIZE + 1 : 0;
+
+        for(uint64_t i = max(begin, valid); i < head; ++i) {
+            const auto& span = spans[i - begin];
+            fprintf(file, "%s\n{\"name\":\"", first ? "" : ",");
+            WriteEscaped(file, span.first);
+            // Timestamps are in microseconds
+            fprintf(file, "\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    pid, ring->tid, span.second.first / 1000.0, (span.second.second - span.second.first) / 1000.0);
+            first = false;
+        }
+    }
+    fputs("\n]}\n", file);
+
+    if(fclose(file) != 0 || rename(tmp_path.c_str(), trace_path.c_str()) != 0) {
+        perror("trace export");
+        unlink(tmp_path.c_str());
+    }
+}
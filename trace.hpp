@@ -0,0 +1,61 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <cstdint>
+
+// Spans kept per thread, the oldest ones are overwritten. Must be a power of two
+#define TRACE_RING_SIZE (1 << 16)
+
+// Opt-in timeline tracing. When started, every TRACE_SPAN records its name, start and duration into a
+// ring buffer of the current thread. Recording takes no locks and does no allocation after a thread's
+// first span, and is a single load and branch while tracing is off. TraceExport() writes all rings as
+// Chrome trace-event JSON, which chrome://tracing and Perfetto open
+
+// Enable tracing, exporting to path
+void TraceStart(const char *path);
+
+// Name the current thread in the exported trace. name must be a literal
+void TraceThreadName(const char *name);
+
+// Write the spans of all threads to the path given to TraceStart(). Does nothing while tracing is off
+void TraceExport();
+
+namespace trace_detail {
+
+extern ::std::atomic<bool> enabled;
+
+uint64_t Now();
+
+void Record(const char *name, uint64_t start, uint64_t end);
+
+// Times its own lifetime
+class Scope {
+    public:
+        explicit Scope(const char *name) : name_(name), start_(enabled.load(::std::memory_order_relaxed) ? Now() : 0) {}
+
+        ~Scope() {
+            if(start_)
+                Record(name_, start_, Now());
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char *name_;
+        uint64_t start_;
+};
+
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+// Record a span from here to the end of the enclosing scope. name must be a literal
+#define TRACE_SPAN(name) ::trace_detail::Scope TRACE_CONCAT(trace_span_, __LINE__)(name)
+
+// Record a span around a single call, e.g. a blocking Xlib round trip, and return its result
+#define TRACE_CALL(name, call) ([&]() -> decltype(call) { TRACE_SPAN(name); return call; }())
+
+#endif
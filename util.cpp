@@ -0,0 +1,89 @@
+#include "util.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+string CacheDirectory() {
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    string dir;
+    if(cache_home && *cache_home) {
+        dir = string(cache_home) + "/linuxxp";
+    } else if(home) {
+        mkdir((string(home) + "/.cache").c_str(), 0700);
+        dir = string(home) + "/.cache/linuxxp";
+    } else {
+        return dir;
+    }
+    mkdir(dir.c_str(), 0700);
+    return dir;
+}
+
+bool MappedFile::Open(const string& path) {
+    Close();
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(map != MAP_FAILED) {
+            data = static_cast<const uint8_t*>(map);
+            length = st.st_size;
+        }
+    }
+    close(fd);
+    return data != nullptr;
+}
+
+void MappedFile::Close() {
+    if(data)
+        munmap(const_cast<uint8_t*>(data), length);
+    data = nullptr;
+    length = 0;
+}
+
+bool WriteFileAtomic(const string& path, initializer_list<FileChunk> chunks) {
+    const string tmp_path = path + ".tmp." + to_string(getpid());
+    FILE *file = fopen(tmp_path.c_str(), "wb");
+    if(!file)
+        return false;
+    bool ok = true;
+    for(const FileChunk& chunk : chunks) {
+        ok = ok && fwrite(chunk.data, 1, chunk.length, file) == chunk.length;
+    }
+    ok = fclose(file) == 0 && ok;
+    if(!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+void RemoveStaleTempFiles(const string& dir) {
+    DIR *handle = opendir(dir.c_str());
+    if(!handle)
+        return;
+    while(dirent *ent = readdir(handle)) {
+        // <name>.tmp.<pid>
+        const char *tmp = strstr(ent->d_name, ".tmp.");
+        if(!tmp)
+            continue;
+        char *end;
+        const long pid = strtol(tmp + 5, &end, 10);
+        if(pid <= 0 || *end != '\0')
+            continue;
+        if(kill(pid, 0) < 0 && errno == ESRCH)
+            unlink((dir + "/" + ent->d_name).c_str());
+    }
+    closedir(handle);
+}
@@ -1,6 +1,11 @@
 #ifndef UTIL_HPP
 #define UTIL_HPP
 
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+
 // Represents a 2D size.
 template <typename T>
 struct Size {
@@ -35,4 +40,62 @@ struct Vector2D {
 
 };
 
+// Represents an axis-aligned rectangle
+template <typename T>
+struct Rect {
+  T x, y, width, height;
+
+  Rect() = default;
+  Rect(T _x, T _y, T w, T h)
+      : x(_x), y(_y), width(w), height(h) {
+  }
+
+  bool Contains(T px, T py) const {
+      return px >= x && px < x + width && py >= y && py < y + height;
+  }
+
+  bool operator==(const Rect& other) const {
+      return x == other.x && y == other.y && width == other.width && height == other.height;
+  }
+
+  bool operator!=(const Rect& other) const {
+      return !(*this == other);
+  }
+
+};
+
+// Directory for files cached between runs, $XDG_CACHE_HOME/linuxxp or ~/.cache/linuxxp.
+// Created if it doesn't exist. Empty if neither variable is set
+::std::string CacheDirectory();
+
+// Read-only mapping of a whole file, unmapped when it goes out of scope
+class MappedFile {
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile() { Close(); }
+
+        // Map path, replacing any previous mapping. Returns false if it can't be read or is empty
+        bool Open(const ::std::string& path);
+
+        void Close();
+
+        const uint8_t *data = nullptr;
+        size_t length = 0;
+};
+
+// Part of the contents for WriteFileAtomic
+struct FileChunk {
+    const void *data;
+    size_t length;
+};
+
+// Write the chunks one after another to a temporary file and rename it to path, so readers never see
+// half a file. Returns false, leaving nothing behind, if that fails
+bool WriteFileAtomic(const ::std::string& path, ::std::initializer_list<FileChunk> chunks);
+
+// Remove the temporary files of WriteFileAtomic in dir whose process is gone, e.g. after a crash
+void RemoveStaleTempFiles(const ::std::string& dir);
+
 #endif
@@ -0,0 +1,285 @@
+#include "wallpaper.hpp"
+extern "C" {
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+}
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include "image.hpp"
+#include "scale.hpp"
+#include "trace.hpp"
+
+using namespace std;
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+namespace {
+
+uint64_t Fnv1a(const uint8_t *data, size_t length) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for(size_t i = 0; i < length; ++i) {
+        hash = (hash ^ data[i])*FNV_PRIME;
+    }
+    return hash;
+}
+
+// Set by TrapShmError while attaching a shared memory segment
+bool shm_error = false;
+
+int TrapShmError(Display *, XErrorEvent *) {
+    shm_error = true;
+    return 0;
+}
+
+}
+
+bool Wallpaper::Load(const string& path) {
+    MappedFile file;
+    if(!file.Open(path)) {
+        fprintf(stderr, "Cannot open wallpaper: %s\n", path.c_str());
+        return false;
+    }
+    path_ = path;
+    source_hash_ = Fnv1a(file.data, file.length);
+    // Nothing of the previous image can be reused
+    outputs_.clear();
+
+    cache_dir_ = CacheDirectory();
+    return true;
+}
+
+string Wallpaper::CachePath(int width, int height) const {
+    char name[64];
+    snprintf(name, sizeof(name), "/wallpaper-%016llx-%dx%d.raw", (unsigned long long)source_hash_, width, height);
+    return cache_dir_ + name;
+}
+
+void Wallpaper::PruneCache(const vector<Rect<int>>& outputs) const {
+    if(cache_dir_.empty())
+        return;
+    RemoveStaleTempFiles(cache_dir_);
+
+    // Other WM instances share the directory, so a file is only removed once nobody used it for a long time
+    DIR *dir = opendir(cache_dir_.c_str());
+    if(!dir)
+        return;
+    const time_t oldest = time(nullptr) - WALLPAPER_CACHE_MAX_AGE;
+    while(dirent *ent = readdir(dir)) {
+        const size_t length = strlen(ent->d_name);
+        if(strncmp(ent->d_name, "wallpaper-", 10) != 0 || length <= 4 || strcmp(ent->d_name + length - 4, ".raw") != 0)
+            continue;
+        const string path = cache_dir_ + "/" + ent->d_name;
+        bool keep = false;
+        for(const Rect<int>& output : outputs) {
+            keep = keep || path == CachePath(output.width, output.height);
+        }
+        struct stat st;
+        if(!keep && stat(path.c_str(), &st) == 0 && st.st_mtime < oldest)
+            unlink(path.c_str());
+    }
+    closedir(dir);
+}
+
+bool Wallpaper::Scale(int width, int height, vector<uint32_t>& pixels) {
+    TRACE_SPAN("ScaleWallpaper");
+    if(source_.empty() && !LoadImagePixels(path_.c_str(), source_, source_width_, source_height_))
+        return false;
+
+    // Zoom to fill: crop the source to the aspect ratio of the output, centered
+    int crop_width = source_width_, crop_height = source_height_;
+    if(int64_t(source_width_)*height > int64_t(width)*source_height_) {
+        crop_width = max<int>(1, int64_t(width)*source_height_ / height);
+    } else {
+        crop_height = max<int>(1, int64_t(height)*source_width_ / width);
+    }
+    const uint32_t *crop = source_.data() + int64_t((source_height_ - crop_height)/2)*source_width_ + (source_width_ - crop_width)/2;
+
+    pixels.resize(size_t(width)*height);
+    ResampleBilinear(crop, source_width_, crop_width, crop_height, pixels.data(), width, height);
+    return true;
+}
+
+void Wallpaper::WriteCache(const string& cache_path, const vector<uint32_t>& pixels, int width, int height) {
+    if(cache_dir_.empty())
+        return;
+
+    WallpaperCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, WALLPAPER_CACHE_MAGIC, sizeof(header.magic));
+    header.source_hash = source_hash_;
+    header.width = width;
+    header.height = height;
+
+    WriteFileAtomic(cache_path, { { &header, sizeof(header) }, { pixels.data(), pixels.size()*sizeof(uint32_t) } });
+}
+
+bool Wallpaper::UploadShm(Display *display, Pixmap pix, GC gc, const uint32_t *pixels, const Rect<int>& rect) {
+    int screen_num = DefaultScreen(display);
+    XShmSegmentInfo info;
+    XImage *image = XShmCreateImage(display, DefaultVisual(display, screen_num), DefaultDepth(display, screen_num),
+            ZPixmap, nullptr, &info, rect.width, rect.height);
+    if(!image)
+        return false;
+    if(image->bits_per_pixel != 32) {
+        XDestroyImage(image);
+        return false;
+    }
+
+    info.shmid = shmget(IPC_PRIVATE, size_t(image->bytes_per_line)*rect.height, IPC_CREAT | 0600);
+    if(info.shmid < 0) {
+        XDestroyImage(image);
+        return false;
+    }
+    info.shmaddr = image->data = static_cast<char*>(shmat(info.shmid, nullptr, 0));
+    info.readOnly = True;
+
+    // Attaching fails on remote displays, which is only reported as an X error
+    bool attached = false;
+    if(info.shmaddr != reinterpret_cast<char*>(-1)) {
+        TRACE_CALL("XSync", XSync(display, False));
+        shm_error = false;
+        XErrorHandler previous = XSetErrorHandler(TrapShmError);
+        XShmAttach(display, &info);
+        TRACE_CALL("XSync", XSync(display, False));
+        XSetErrorHandler(previous);
+        attached = !shm_error;
+    }
+
+    // Marked for removal now, it goes away once both sides have detached
+    shmctl(info.shmid, IPC_RMID, nullptr);
+
+    if(attached) {
+        for(int y = 0; y < rect.height; ++y) {
+            memcpy(image->data + size_t(y)*image->bytes_per_line, pixels + size_t(y)*rect.width, size_t(rect.width)*4);
+        }
+        XShmPutImage(display, pix, gc, image, 0, 0, rect.x, rect.y, rect.width, rect.height, False);
+
+        // The server has to be done reading the segment before it is detached
+        TRACE_CALL("XSync", XSync(display, False));
+        XShmDetach(display, &info);
+    }
+    if(info.shmaddr != reinterpret_cast<char*>(-1))
+        shmdt(info.shmaddr);
+    image->data = nullptr;
+    XDestroyImage(image);
+    return attached;
+}
+
+void Wallpaper::Upload(Display *display, Pixmap pix, GC gc, const uint32_t *pixels, const Rect<int>& rect) {
+    TRACE_SPAN("UploadWallpaper");
+    if(use_shm_) {
+        if(UploadShm(display, pix, gc, pixels, rect))
+            return;
+        use_shm_ = false;
+    }
+
+    // The XImage only borrows the pixels. Xlib splits it into requests the server accepts
+    int screen_num = DefaultScreen(display);
+    XImage *image = XCreateImage(display, DefaultVisual(display, screen_num), DefaultDepth(display, screen_num), ZPixmap, 0,
+            const_cast<char*>(reinterpret_cast<const char*>(pixels)), rect.width, rect.height, 32, 0);
+    XPutImage(display, pix, gc, image, 0, 0, rect.x, rect.y, rect.width, rect.height);
+    image->data = nullptr;
+    XDestroyImage(image);
+}
+
+void Wallpaper::Release(Display *display, Window root) {
+    if(pixmap == None)
+        return;
+
+    // Nobody may use the pixmap through the properties once it is freed
+    XDeleteProperty(display, root, TRACE_CALL("XInternAtom", XInternAtom(display, "_XROOTPMAP_ID", False)));
+    XDeleteProperty(display, root, TRACE_CALL("XInternAtom", XInternAtom(display, "ESETROOT_PMAP_ID", False)));
+    pixmap.reset();
+    outputs_.clear();
+}
+
+void Wallpaper::Render(Display *display, Window root, const vector<Rect<int>>& outputs) {
+    if(path_.empty() || outputs.empty())
+        return;
+    if(pixmap != None && outputs == outputs_)
+        return;
+
+    int screen_num = DefaultScreen(display);
+    if(DefaultDepth(display, screen_num) < 24) {
+        fprintf(stderr, "Wallpaper needs a 24-bit visual\n");
+        return;
+    }
+    if(!TRACE_CALL("XShmQueryExtension", XShmQueryExtension(display)))
+        use_shm_ = false;
+
+    // The root pixmap spans all outputs. Parts no output covers stay black
+    int width = 0, height = 0;
+    for(const Rect<int>& output : outputs) {
+        width = max(width, output.x + output.width);
+        height = max(height, output.y + output.height);
+    }
+    Pixmap pix = XCreatePixmap(display, root, width, height, DefaultDepth(display, screen_num));
+    XGCValues gc_values;
+    gc_values.foreground = BlackPixel(display, screen_num);
+    OwnedGC gc(display, XCreateGC(display, pix, GCForeground, &gc_values));
+    XFillRectangle(display, pix, gc, 0, 0, width, height);
+
+    vector<uint32_t> scaled;
+    for(const Rect<int>& output : outputs) {
+        // An output that kept its size only moved, if at all, so its part of the old pixmap is still right
+        auto previous = find_if(outputs_.begin(), outputs_.end(), [&output](const Rect<int>& r) {
+            return r.width == output.width && r.height == output.height;
+        });
+        if(pixmap != None && previous != outputs_.end()) {
+            XCopyArea(display, pixmap, pix, gc, previous->x, previous->y, output.width, output.height, output.x, output.y);
+            continue;
+        }
+
+        const string cache_path = CachePath(output.width, output.height);
+
+        // A cache file is only used if it is complete and matches the image and size
+        MappedFile cached;
+        if(!cache_dir_.empty() && cached.Open(cache_path)) {
+            const WallpaperCacheHeader *header = reinterpret_cast<const WallpaperCacheHeader*>(cached.data);
+            if(cached.length == sizeof(WallpaperCacheHeader) + size_t(output.width)*output.height*4
+                    && memcmp(header->magic, WALLPAPER_CACHE_MAGIC, sizeof(header->magic)) == 0
+                    && header->source_hash == source_hash_
+                    && int(header->width) == output.width && int(header->height) == output.height) {
+                Upload(display, pix, gc, reinterpret_cast<const uint32_t*>(cached.data + sizeof(WallpaperCacheHeader)), output);
+                // Marks the file as recently used for PruneCache
+                utimes(cache_path.c_str(), nullptr);
+                continue;
+            }
+        }
+
+        if(!Scale(output.width, output.height, scaled))
+            break;
+        WriteCache(cache_path, scaled, output.width, output.height);
+        Upload(display, pix, gc, scaled.data(), output);
+    }
+
+    // The decoded image is large and only needed again if the outputs change to an uncached size
+    vector<uint32_t>().swap(source_);
+
+    XSetWindowBackgroundPixmap(display, root, pix);
+    XClearWindow(display, root);
+
+    // Published for compositors and terminals that draw the wallpaper themselves
+    XChangeProperty(display, root, TRACE_CALL("XInternAtom", XInternAtom(display, "_XROOTPMAP_ID", False)), XA_PIXMAP, 32,
+            PropModeReplace, reinterpret_cast<unsigned char*>(&pix), 1);
+    XChangeProperty(display, root, TRACE_CALL("XInternAtom", XInternAtom(display, "ESETROOT_PMAP_ID", False)), XA_PIXMAP, 32,
+            PropModeReplace, reinterpret_cast<unsigned char*>(&pix), 1);
+
+    // Replaces, and frees, the previous wallpaper
+    pixmap.reset(display, pix);
+    outputs_ = outputs;
+
+    // Sizes no output uses anymore would only pile up
+    PruneCache(outputs);
+}
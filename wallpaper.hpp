@@ -0,0 +1,81 @@
+#ifndef WALLPAPER_HPP
+#define WALLPAPER_HPP
+
+extern "C" {
+#include <X11/Xlib.h>
+}
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "util.hpp"
+#include "resource.hpp"
+
+// Identifies a wallpaper cache file, followed by the version of its layout
+#define WALLPAPER_CACHE_MAGIC "LXPWALL1"
+
+// Cached sizes not used for this long (in seconds) are removed. A cache hit counts as a use
+#define WALLPAPER_CACHE_MAX_AGE (30*24*60*60)
+
+// Header of a cached wallpaper, already scaled to one output size. The pixels follow it,
+// 0xAARRGGBB and width*height of them, so the file can be mmapped and uploaded as is
+struct WallpaperCacheHeader {
+    char magic[8];
+    uint64_t source_hash;
+    uint32_t width, height;
+    // Pads the header to 32 bytes so the pixels are 16-byte aligned
+    uint32_t reserved[2];
+};
+
+// Paints the root window with an image, zoomed to fill each output and cropped to its aspect ratio.
+// Every output size is scaled once and then cached on disk in $XDG_CACHE_HOME/linuxxp, keyed by a hash
+// of the image and the size, so later logins only mmap the cache and upload it (through MIT-SHM
+// when the server is local). Sizes nobody has used for a while are dropped from the cache. The root pixmap is published as _XROOTPMAP_ID for compositors and terminals
+class Wallpaper {
+    public:
+        // Use the image at path. The file is hashed now but only decoded when a size isn't cached
+        bool Load(const ::std::string& path);
+
+        // Paint the outputs onto a new root pixmap and publish it, replacing the previous one. Outputs that
+        // kept their size are copied from the previous pixmap, and nothing happens if none of them changed
+        void Render(Display *display, Window root, const ::std::vector<Rect<int>>& outputs);
+
+        // Unpublish and free the root pixmap. The root keeps showing it as its background
+        void Release(Display *display, Window root);
+
+        // Root pixmap currently shown
+        OwnedPixmap pixmap;
+
+    private:
+        // Scale the image to width x height, decoding it first if needed
+        bool Scale(int width, int height, ::std::vector<uint32_t>& pixels);
+
+        // Write scaled pixels to the cache, atomically so a crash never leaves half a file
+        void WriteCache(const ::std::string& cache_path, const ::std::vector<uint32_t>& pixels, int width, int height);
+
+        // Cache file for one output size
+        ::std::string CachePath(int width, int height) const;
+
+        // Remove the cached wallpapers that no instance has used for WALLPAPER_CACHE_MAX_AGE, except those for
+        // the current image at one of the sizes of outputs, and files left behind by interrupted writes
+        void PruneCache(const ::std::vector<Rect<int>>& outputs) const;
+
+        // Copy pixels into pix at rect, through shared memory if possible
+        void Upload(Display *display, Pixmap pix, GC gc, const uint32_t *pixels, const Rect<int>& rect);
+        bool UploadShm(Display *display, Pixmap pix, GC gc, const uint32_t *pixels, const Rect<int>& rect);
+
+        ::std::string path_;
+        ::std::string cache_dir_;
+        uint64_t source_hash_ = 0;
+
+        // Outputs the current pixmap was rendered for
+        ::std::vector<Rect<int>> outputs_;
+
+        // Decoded image, only kept while a Render() needs it
+        ::std::vector<uint32_t> source_;
+        int source_width_ = 0, source_height_ = 0;
+
+        // Cleared once MIT-SHM failed, e.g. on a remote display
+        bool use_shm_ = true;
+};
+
+#endif
@@ -1,22 +1,57 @@
 #include "window_manager.hpp"
 #include "frame.hpp"
+#include "placement.hpp"
 #include <X11/X.h>
 #include <X11/Xlib.h>
 extern "C" {
 #include <X11/Xutil.h>
+#include <X11/Xatom.h>
 }
 #include "util.hpp"
+#include "trace.hpp"
+#include <csignal>
+#include <cerrno>
 #include <cstdio>
 #include <iostream>
 #include <algorithm>
 #include <cstring>
+#include <chrono>
+#include <cstdlib>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 using ::std::unique_ptr;
 using namespace std;
 
 bool WindowManager::wm_detected_;
 
+namespace {
+
+IpcEvent MakeIpcEvent(uint32_t event, Window w, const Frame *frame) {
+    IpcEvent ev = { event, uint32_t(w), 0, 0, 0, 0 };
+    if(frame) {
+        ev.x = frame->position.x;
+        ev.y = frame->position.y;
+        ev.width = frame->size.width;
+        ev.height = frame->size.height;
+    }
+    return ev;
+}
+
+}
+
+int WindowManager::signal_pipe_[2] = { -1, -1 };
+
 unique_ptr<WindowManager> WindowManager::Create() {
+    // Opt-in tracing, before anything worth tracing happens
+    if(const char *trace_path = getenv("LINUXXP_TRACE")) {
+        TraceStart(trace_path);
+    }
+
+    // The icon workers use Xlib from other threads, on their own connections
+    XInitThreads();
+
     // Open X Display
     Display* display = XOpenDisplay(nullptr);
     if(display == nullptr){
@@ -29,11 +64,54 @@ unique_ptr<WindowManager> WindowManager::Create() {
 }
 
 WindowManager::WindowManager(Display* display) : display_(display), root_(DefaultRootWindow(display_)),
-    WM_PROTOCOLS(XInternAtom(display_, "WM_PROTOCOLS", false)),
-    WM_DELETE_WINDOW(XInternAtom(display_, "WM_DELETE_WINDOW", false)) {}
+    WM_PROTOCOLS(TRACE_CALL("XInternAtom", XInternAtom(display_, "WM_PROTOCOLS", false))),
+    WM_DELETE_WINDOW(TRACE_CALL("XInternAtom", XInternAtom(display_, "WM_DELETE_WINDOW", false))),
+    NET_WM_ICON(TRACE_CALL("XInternAtom", XInternAtom(display_, "_NET_WM_ICON", false))),
+    NET_WM_NAME(TRACE_CALL("XInternAtom", XInternAtom(display_, "_NET_WM_NAME", false))),
+    UTF8_STRING(TRACE_CALL("XInternAtom", XInternAtom(display_, "UTF8_STRING", false))),
+    NET_SUPPORTED(TRACE_CALL("XInternAtom", XInternAtom(display_, "_NET_SUPPORTED", false))),
+    NET_SUPPORTING_WM_CHECK(TRACE_CALL("XInternAtom", XInternAtom(display_, "_NET_SUPPORTING_WM_CHECK", false))),
+    NET_WM_STATE(TRACE_CALL("XInternAtom", XInternAtom(display_, "_NET_WM_STATE", false))),
+    NET_WM_STATE_FULLSCREEN(TRACE_CALL("XInternAtom", XInternAtom(display_, "_NET_WM_STATE_FULLSCREEN", false))) {}
 
 WindowManager::~WindowManager() {
+    // Spans up to the exit
+    TraceExport();
+
+    // Give the clients back to the root where they are now, so they survive the frames being destroyed
+    for(Window w : client_order_) {
+        const Rect<int> client = clients_[w].ClientRect();
+        XReparentWindow(display_, w, root_, client.x, client.y);
+        XRemoveFromSaveSet(display_, w);
+        XMapWindow(display_, w);
+    }
+    XSync(display_, false);
+
+    // Everything owned by the WM has to be freed while the display is still open
+    frame_being_moved_resized = nullptr;
+    frame_being_closed = nullptr;
+    frames_.clear();
+    clients_.clear();
+    client_order_.clear();
+    outputs_.outputs.clear();
+    for(OwnedCursor *cursor : { &default_cursor, &top_left_cursor, &top_right_cursor, &bottom_left_cursor,
+            &bottom_right_cursor, &bottom_cursor, &top_cursor, &left_cursor, &right_cursor }) {
+        cursor->reset();
+    }
+    title_gc_.reset();
+    wm_check_win_.reset();
+    wallpaper_.Release(display_, root_);
+    start_menu_.items_pix.reset();
+    start_menu_.hover_pix.reset();
+    start_menu_.menu_win.reset();
+    frame_theme_ = FrameTheme();
+    title_font_.Close(display_);
     XCloseDisplay(display_);
+
+    if(signal_pipe_[0] >= 0) {
+        close(signal_pipe_[0]);
+        close(signal_pipe_[1]);
+    }
 }
 
 void WindowManager::Start(){
@@ -48,13 +126,13 @@ void WindowManager::Setup() {
     XSetErrorHandler(&WindowManager::OnWMDetected);
 
     // Select events on the root
-    XSelectInput(display_, root_, SubstructureRedirectMask | SubstructureNotifyMask | ButtonPressMask | ButtonReleaseMask | ButtonMotionMask
-            | KeyPressMask | KeyReleaseMask | PointerMotionMask);
+    XSelectInput(display_, root_, ROOT_EVENT_MASK | ROOT_MOTION_MASK);
 
     // Syncronously grab the the left button on the root
     XGrabButton(display_, Button1, AnyModifier, root_, false, Button1Mask, GrabModeSync, GrabModeAsync, None, None);
 
     XGrabKey(display_, XKeysymToKeycode(display_, XK_r), Mod1Mask, root_, false, GrabModeAsync, GrabModeAsync);
+    XGrabKey(display_, XKeysymToKeycode(display_, XK_t), Mod1Mask, root_, false, GrabModeAsync, GrabModeAsync);
 
 
     XSync(display_, false);
@@ -66,16 +144,63 @@ void WindowManager::Setup() {
     // Set error handler
     XSetErrorHandler(&WindowManager::OnXError);
 
+    // Titlebar font and the GC that clears behind the titles
+    title_font_.Open(display_, TITLE_FONT);
+    XGCValues title_gc_values;
+    title_gc_values.foreground = FRAME_BG_COLOR;
+    title_gc_.reset(display_, XCreateGC(display_, root_, GCForeground, &title_gc_values));
+
+    // Button images, loaded once for all frames
+    frame_theme_.Load(display_, root_);
+
+    // EWMH hints we support, and the check window that says so
+    wm_check_win_.reset(display_, XCreateSimpleWindow(display_, root_, -1, -1, 1, 1, 0, 0, 0));
+    Window check_win = wm_check_win_;
+    XChangeProperty(display_, root_, NET_SUPPORTING_WM_CHECK, XA_WINDOW, 32, PropModeReplace, reinterpret_cast<unsigned char*>(&check_win), 1);
+    XChangeProperty(display_, check_win, NET_SUPPORTING_WM_CHECK, XA_WINDOW, 32, PropModeReplace, reinterpret_cast<unsigned char*>(&check_win), 1);
+    XChangeProperty(display_, check_win, NET_WM_NAME, UTF8_STRING, 8, PropModeReplace, reinterpret_cast<const unsigned char*>("LinuxXP"), 7);
+    Atom supported[] = { NET_SUPPORTED, NET_SUPPORTING_WM_CHECK, NET_WM_NAME, NET_WM_ICON, NET_WM_STATE, NET_WM_STATE_FULLSCREEN };
+    XChangeProperty(display_, root_, NET_SUPPORTED, XA_ATOM, 32, PropModeReplace, reinterpret_cast<unsigned char*>(supported),
+            sizeof(supported)/sizeof(supported[0]));
+
+    // Control socket, only for this user. Children find it through LINUXXP_SOCKET
+    string display_name = DisplayString(display_);
+    replace(display_name.begin(), display_name.end(), '/', '_');
+    const string socket_path = IpcSocketPath(display_name);
+    if(!socket_path.empty() && ipc_.Start(socket_path)) {
+        setenv("LINUXXP_SOCKET", socket_path.c_str(), 1);
+    }
+
+    // Signals are only noted by the handler and acted on in the main loop
+    if(pipe2(signal_pipe_, O_NONBLOCK | O_CLOEXEC) == 0) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = &WindowManager::OnSignal;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGTERM, &action, nullptr);
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGUSR2, &action, nullptr);
+    } else {
+        perror("signal pipe");
+    }
+
+    // Start the icon workers before framing so existing windows get their icons too
+    icons_.Start(DisplayString(display_), FRAME_BG_COLOR);
+
     // Grab X server to prevent windows from changes while framing them
     XGrabServer(display_);
 
+    // Query the outputs and set up a bar on each of them
+    outputs_.Create(display_, root_);
+
     // Frame existing top-level windows
 
     // Query existing top-level windows
     Window returned_root, returned_parent;
     Window* top_level_windows;
     unsigned int num_top_level_windows;
-    XQueryTree(display_, root_, &returned_root, &returned_parent, &top_level_windows, &num_top_level_windows);
+    TRACE_CALL("XQueryTree", XQueryTree(display_, root_, &returned_root, &returned_parent, &top_level_windows, &num_top_level_windows));
 
     // Frame each top-level window
     for(unsigned int i = 0; i < num_top_level_windows; ++i){
@@ -86,81 +211,190 @@ void WindowManager::Setup() {
     XFree(top_level_windows);
 
     // Create cursors
-    top_left_cursor = XCreateFontCursor(display_, XC_top_left_corner);
-    top_right_cursor = XCreateFontCursor(display_, XC_top_right_corner);
-    bottom_left_cursor = XCreateFontCursor(display_, XC_bottom_left_corner);
-    bottom_right_cursor = XCreateFontCursor(display_, XC_bottom_right_corner);
-    bottom_left_cursor = XCreateFontCursor(display_, XC_bottom_left_corner);
-    bottom_cursor = XCreateFontCursor(display_, XC_bottom_side);
-    top_cursor = XCreateFontCursor(display_, XC_top_side);
-    left_cursor = XCreateFontCursor(display_, XC_left_side);
-    right_cursor = XCreateFontCursor(display_, XC_right_side);
-    default_cursor = XCreateFontCursor(display_, XC_left_ptr);
+    top_left_cursor.reset(display_, XCreateFontCursor(display_, XC_top_left_corner));
+    top_right_cursor.reset(display_, XCreateFontCursor(display_, XC_top_right_corner));
+    bottom_left_cursor.reset(display_, XCreateFontCursor(display_, XC_bottom_left_corner));
+    bottom_right_cursor.reset(display_, XCreateFontCursor(display_, XC_bottom_right_corner));
+    bottom_cursor.reset(display_, XCreateFontCursor(display_, XC_bottom_side));
+    top_cursor.reset(display_, XCreateFontCursor(display_, XC_top_side));
+    left_cursor.reset(display_, XCreateFontCursor(display_, XC_left_side));
+    right_cursor.reset(display_, XCreateFontCursor(display_, XC_right_side));
+    default_cursor.reset(display_, XCreateFontCursor(display_, XC_left_ptr));
     XDefineCursor(display_, root_, default_cursor);
 
-    // Set up the bar
-    bar.Create(display_, root_);
     printf("%s", "TESTING\n");
 
+    start_menu_.Create(display_, root_);
+
     // Ungrab X server
     XUngrabServer(display_);
+
+    // Start menu items rendered up front so the first click opens it right away. After the ungrab, since
+    // building the index on a cold cache reads every .desktop file
+    start_menu_.Prepare(display_, root_, title_font_, outputs_.outputs.front().rect);
+
+    // Wallpaper, after the ungrab since the first render of an image has to decode and scale it
+    const char *wallpaper = getenv("LINUXXP_WALLPAPER");
+    if(wallpaper && wallpaper_.Load(wallpaper)) {
+        RenderWallpaper();
+    }
 }
 
 void WindowManager::Run() {
 
-    // Main event loop
-    for (;;) {
-        // Get next event
-        XEvent e;
-        XNextEvent(display_, &e);
-
-        // Choose event
-        switch (e.type) {
-            case ReparentNotify:
-                OnReparentNotify(e.xreparent);
-                //printf("ReparentNotify\n");
-                break;
-            case MapRequest:
-                OnMapRequest(e.xmaprequest);
-                //printf("MapRequest\n");
-                break;
-            case ConfigureRequest:
-                OnConfigureRequest(e.xconfigurerequest);
-                //printf("ConfigureRequest\n");
-                break;
-            case UnmapNotify:
-                OnUnmapNotify(e.xunmap);
-                //printf("UnmapNotify\n");
-                break;
-            case ButtonPress:
-                OnButtonPress(e.xbutton);
-                UpdateCursor(e);
-                //printf("ButtonPress\n");
-                break;
-            case ButtonRelease:
-                OnButtonRelease(e.xbutton);
+    // Main event loop, until SIGTERM or SIGINT
+    while (running_) {
+        // Handle every event that is already queued
+        while (XPending(display_)) {
+            // Get next event
+            XEvent e;
+            XNextEvent(display_, &e);
+            Dispatch(e);
+        }
+
+        // Merged ConfigureRequests of this batch
+        ApplyConfigureRequests();
+
+        // Icons loaded by the workers
+        ApplyIcons();
+
+        // Titles that changed since the last repaint
+        int timeout = PaintTitles();
+
+        // Geometry changes for IPC subscribers, one event per frame per pass
+        BroadcastGeometry();
+        XFlush(display_);
+
+        // The round trips above may have read events into Xlib's queue, which poll() can't see.
+        // Only look at the other sources then, and come straight back for them
+        if(XEventsQueued(display_, QueuedAlready) > 0)
+            timeout = 0;
+
+        // Sleep until the X server, an icon worker or an IPC client has something
+        vector<pollfd> fds = {
+            { ConnectionNumber(display_), POLLIN, 0 },
+            { icons_.wake_fd, POLLIN, 0 },
+            { signal_pipe_[0], POLLIN, 0 },
+        };
+        const size_t ipc_first = fds.size();
+        ipc_.AddPollFds(fds);
+        TRACE_CALL("poll", poll(fds.data(), fds.size(), timeout));
+
+        if(fds[2].revents & POLLIN) {
+            HandleSignals();
+        }
+
+        // Commands from the control socket
+        vector<IpcMessage> messages;
+        ipc_.HandleEvents(fds, ipc_first, messages);
+        HandleIpc(messages);
+    }
+}
+
+void WindowManager::Dispatch(XEvent& e) {
+    TRACE_SPAN("Dispatch");
+    // Choose event
+    switch (e.type) {
+        case ReparentNotify:
+            OnReparentNotify(e.xreparent);
+            //printf("ReparentNotify\n");
+            break;
+        case MapRequest:
+            // The window is framed with the geometry it asked for before it was mapped
+            ApplyConfigureRequests();
+            OnMapRequest(e.xmaprequest);
+            //printf("MapRequest\n");
+            break;
+        case ConfigureRequest:
+            OnConfigureRequest(e.xconfigurerequest);
+            //printf("ConfigureRequest\n");
+            break;
+        case UnmapNotify:
+            OnUnmapNotify(e.xunmap);
+            //printf("UnmapNotify\n");
+            break;
+        case DestroyNotify:
+            OnDestroyNotify(e.xdestroywindow);
+            break;
+        case ButtonPress:
+            OnButtonPress(e.xbutton);
+            if(!input_suspended_)
                 UpdateCursor(e);
-                //printf("ButtonRelease\n");
-                break;
-            case MotionNotify:
-                OnMotionNotify(e.xmotion);
+            //printf("ButtonPress\n");
+            break;
+        case ButtonRelease:
+            OnButtonRelease(e.xbutton);
+            if(!input_suspended_)
                 UpdateCursor(e);
-                //printf("MotionNotify\n");
-                break;
-            case KeyPress:
-                OnKeyPress(e.xkey);
-                //printf("KeyPress\n");
+            //printf("ButtonRelease\n");
+            break;
+        case MotionNotify:
+            // Only ones that were queued before a fullscreen client got the focus
+            if(input_suspended_)
                 break;
-            // ...
-            default:
-                //printf("Ignored Event\n");
+            OnMotionNotify(e.xmotion);
+            UpdateCursor(e);
+            //printf("MotionNotify\n");
+            break;
+        case EnterNotify:
+        case LeaveNotify:
+            // The pointer left the start menu, so nothing is highlighted anymore
+            if(e.type == LeaveNotify && e.xcrossing.window == start_menu_.menu_win)
+                start_menu_.Hover(display_, -1, -1);
+            // The pointer moved onto or off a fullscreen frame, i.e. between its output and the others
+            else if(e.xcrossing.mode == NotifyNormal && e.xcrossing.detail != NotifyInferior && frames_.count(e.xcrossing.window))
+                UpdateInputMode();
+            break;
+        case KeyPress:
+            OnKeyPress(e.xkey);
+            //printf("KeyPress\n");
+            break;
+        case PropertyNotify:
+            OnPropertyNotify(e.xproperty);
+            break;
+        case ClientMessage:
+            OnClientMessage(e.xclient);
+            break;
+        // ...
+        default: {
+            // Monitor hot-plug and mode changes
+            vector<Rect<int>> changed;
+            if(outputs_.HandleEvent(display_, root_, e, changed)) {
+                RelocateFrames(changed);
+                RenderWallpaper();
                 break;
+            }
+            //printf("Ignored Event\n");
+            break;
         }
+    }
 
-        // Pass through Pointer clicks to the client
-        XAllowEvents(display_, ReplayPointer, e.xbutton.time);
-        XSync(display_, 0);
+    // Pass through Pointer clicks to the client
+    XAllowEvents(display_, ReplayPointer, e.xbutton.time);
+    TRACE_CALL("XSync", XSync(display_, 0));
+}
 
+void WindowManager::OnSignal(int signo) {
+    // Only async-signal-safe calls in here
+    const int saved_errno = errno;
+    const char byte = char(signo);
+    if(write(signal_pipe_[1], &byte, 1) < 0) {
+        // The pipe is full, and the main loop will wake up for what is already in it
+    }
+    errno = saved_errno;
+}
+
+void WindowManager::HandleSignals() {
+    char signals[64];
+    ssize_t count;
+    while((count = read(signal_pipe_[0], signals, sizeof(signals))) > 0) {
+        for(ssize_t i = 0; i < count; ++i) {
+            if(signals[i] == SIGUSR2) {
+                TraceExport();
+            } else {
+                running_ = false;
+            }
+        }
     }
 }
 
@@ -173,35 +407,112 @@ int WindowManager::OnWMDetected(Display* display, XErrorEvent* e) {
 int WindowManager::OnXError(Display* display, XErrorEvent* e) { /* Print e */return 0; }
 
 // Application configures window to set initial size, position, etc.
-// WM receives ConfigureRequest; WM doesn't need to change parameters because window is invisible so it
-// calls XConfigureWindow with the same parameters
+// Clients that resize themselves in a loop can send many of these at once, and only the last value of
+// each field matters, so they are merged per window and applied once the queued events have been dispatched
 void WindowManager::OnConfigureRequest(const XConfigureRequestEvent& e) {
-    XWindowChanges changes;
+    TRACE_SPAN("OnConfigureRequest");
+    auto it = configure_index_.find(e.window);
+    if(it == configure_index_.end()) {
+        configure_index_[e.window] = configure_requests_.size();
+        configure_requests_.push_back(e);
+        return;
+    }
+
+    XConfigureRequestEvent& merged = configure_requests_[it->second];
+    if(e.value_mask & CWX) merged.x = e.x;
+    if(e.value_mask & CWY) merged.y = e.y;
+    if(e.value_mask & CWWidth) merged.width = e.width;
+    if(e.value_mask & CWHeight) merged.height = e.height;
+    if(e.value_mask & CWBorderWidth) merged.border_width = e.border_width;
+    if(e.value_mask & CWStackMode) {
+        // A sibling only applies to the stack mode it came with
+        merged.detail = e.detail;
+        merged.above = e.above;
+        merged.value_mask &= ~CWSibling;
+    }
+    merged.value_mask |= e.value_mask;
+}
 
-    // Copy fields from e to changes
-    changes.x = e.x;
-    changes.y = e.y;
-    changes.width = e.width;
-    changes.height = e.height;
-    changes.border_width = e.border_width;
-    changes.sibling = e.above;
-    changes.stack_mode = e.detail;
+void WindowManager::ApplyConfigureRequests() {
+    TRACE_SPAN("ApplyConfigureRequests");
+    for(const XConfigureRequestEvent& e : configure_requests_) {
+        auto it = clients_.find(e.window);
+        if(it != clients_.end()) {
+            ConfigureFrame(it->second, e);
+            continue;
+        }
 
-    if(clients_.count(e.window)) {
-        const Frame frame = clients_[e.window];
+        // Not managed (yet), so the request is granted as it is
+        XWindowChanges changes;
+        changes.x = e.x;
+        changes.y = e.y;
+        changes.width = e.width;
+        changes.height = e.height;
+        changes.border_width = e.border_width;
+        changes.sibling = e.above;
+        changes.stack_mode = e.detail;
+        XConfigureWindow(display_, e.window, e.value_mask, &changes);
+    }
+    configure_requests_.clear();
+    configure_index_.clear();
+}
+
+void WindowManager::ConfigureFrame(Frame& frame, const XConfigureRequestEvent& e) {
+    const Rect<int> client = frame.ClientRect();
+    bool resized = false;
+
+    // Maximized, tiled and fullscreen frames are placed by the WM, so only the stacking is granted
+    if(!frame.maximized && !frame.tiled && !frame.fullscreen && (e.value_mask & (CWX | CWY | CWWidth | CWHeight))) {
+        const int x = (e.value_mask & CWX) ? e.x : frame.position.x;
+        const int y = (e.value_mask & CWY) ? e.y : frame.position.y;
+        const int width = (e.value_mask & CWWidth) ? max(1, e.width) : client.width;
+        const int height = (e.value_mask & CWHeight) ? max(1, e.height) : client.height;
 
-        // X server knows that this originates from WM and the WM will reveive ConfigureNotify instead of ConfigureRequest,
-        // which can be ignored
-        XConfigureWindow(display_, frame.frame_win, e.value_mask, &changes);
+        // The requested size is the client's, the frame adds the titlebar around it
+        frame.MoveResizeFrame(display_, x, y, width + CLIENT_OFFSET_X, height + CLIENT_OFFSET_Y + 2*BUTTON_PADDING);
+        resized = width != client.width || height != client.height;
     }
 
-    // Grant request by calling XConfigureWindow
-    XConfigureWindow(display_, e.window, e.value_mask, &changes);
+    // Restacking applies to the frame, relative to the frame of the sibling if that is a client too
+    if(e.value_mask & CWStackMode) {
+        XWindowChanges changes;
+        changes.stack_mode = e.detail;
+        unsigned int mask = CWStackMode;
+        auto sibling = clients_.find(e.above);
+        if((e.value_mask & CWSibling) && sibling != clients_.end()) {
+            changes.sibling = sibling->second.frame_win;
+            mask |= CWSibling;
+        }
+        XConfigureWindow(display_, frame.frame_win, mask, &changes);
+    }
+
+    // A resize makes the server send a real ConfigureNotify. Otherwise the client still needs an answer
+    if(!resized)
+        SendConfigureNotify(frame);
+}
+
+void WindowManager::SendConfigureNotify(const Frame& frame) {
+    const Rect<int> client = frame.ClientRect();
+    XEvent event;
+    memset(&event, 0, sizeof(event));
+    event.xconfigure.type = ConfigureNotify;
+    event.xconfigure.display = display_;
+    event.xconfigure.event = frame.client_win;
+    event.xconfigure.window = frame.client_win;
+    event.xconfigure.x = client.x;
+    event.xconfigure.y = client.y;
+    event.xconfigure.width = client.width;
+    event.xconfigure.height = client.height;
+    event.xconfigure.border_width = 0;
+    event.xconfigure.above = None;
+    event.xconfigure.override_redirect = False;
+    XSendEvent(display_, frame.client_win, False, StructureNotifyMask, &event);
 }
 
 // Make the window visible on the screen
 // Client calls XMapWindow() and sends MapRequest to the WM
 void WindowManager::OnMapRequest(const XMapRequestEvent& e) {
+    TRACE_SPAN("OnMapRequest");
     // 1. Frame or re-frame window
     FrameWindow(e.window, false);
 
@@ -212,6 +523,7 @@ void WindowManager::OnMapRequest(const XMapRequestEvent& e) {
 }
 
 void WindowManager::OnUnmapNotify(const XUnmapEvent& e) {
+    TRACE_SPAN("OnUnmapNotify");
     // If the window is a client the WM manages, unframe it upon UnmapNotify
     // Must check because the WM will receive UnmapNotify for a frame window it destroys
     if(!clients_.count(e.window)) {
@@ -227,10 +539,11 @@ void WindowManager::OnUnmapNotify(const XUnmapEvent& e) {
 }
 
 void WindowManager::FrameWindow(Window w, bool was_created_before_wm) {
+    TRACE_SPAN("FrameWindow");
 
     // Retrieve attributes of window to frame
     XWindowAttributes x_window_attrs;
-    XGetWindowAttributes(display_, w, &x_window_attrs);
+    TRACE_CALL("XGetWindowAttributes", XGetWindowAttributes(display_, w, &x_window_attrs));
 
     // Frame existing top-level windows that if they are visible and don't set override_redirect
     if(was_created_before_wm) {
@@ -239,22 +552,338 @@ void WindowManager::FrameWindow(Window w, bool was_created_before_wm) {
         }
     }
 
-    Frame frame;
-    frame.Create(display_, root_, w, x_window_attrs);
+    // The bars are managed by the WM itself
+    if(outputs_.FindBar(w)) {
+        return;
+    }
+
+    // Place new frames, keeping them inside the work area of their output
+    if(!was_created_before_wm) {
+        const Position<int> pos = PlaceFrame(w, x_window_attrs);
+        x_window_attrs.x = pos.x;
+        x_window_attrs.y = pos.y;
+    }
 
     // Save frame handle
-    clients_[w] = frame;
-    frames_[frame.frame_win] = frame;
+    Frame& frame = clients_[w];
+    frame.Create(display_, root_, w, x_window_attrs, frame_theme_);
+    frames_[frame.frame_win] = &frame;
+    client_order_.push_back(w);
+
+    // Watch the client's properties, and load its icon in the background
+    XSelectInput(display_, w, PropertyChangeMask);
+    RequestIcon(frame);
+
+    // Make room for the new frame if its output is tiled
+    const Output& output = outputs_.OutputAt(frame.OuterRect());
+    if(output.layout != Layout::Floating) {
+        Retile(output);
+    }
+
+    // Games and video players often ask for fullscreen before they are mapped
+    if(WantsFullscreen(w)) {
+        SetFullscreen(frame, true);
+    }
+
+    ipc_.Broadcast(MakeIpcEvent(IPC_EVENT_MAP, w, &frame));
 
     // Focus the newly created window
     //TODO: does not work yet
-    XSetInputFocus(display_, w, root_, CurrentTime);
+    SetFocus(w);
+}
+
+
+Position<int> WindowManager::PlaceFrame(Window w, const XWindowAttributes& attrs) {
+    TRACE_SPAN("PlaceFrame");
+    const Rect<int> outer(attrs.x, attrs.y,
+            attrs.width + CLIENT_OFFSET_X + 2*FRAME_BORDER_WIDTH,
+            attrs.height + CLIENT_OFFSET_Y + 2*BUTTON_PADDING + 2*FRAME_BORDER_WIDTH);
+
+    // Respect a position the user asked for. Toolkits set PPosition for nearly every window, usually
+    // to the origin of the screen, so that one only counts when it is somewhere else
+    XSizeHints hints;
+    long supplied;
+    if(TRACE_CALL("XGetWMNormalHints", XGetWMNormalHints(display_, w, &hints, &supplied))) {
+        const Rect<int>& output = outputs_.OutputAt(outer).rect;
+        const bool at_origin = outer.x == output.x && outer.y == output.y;
+        if((hints.flags & USPosition) || ((hints.flags & PPosition) && !at_origin))
+            return outputs_.Clamp(outer);
+    }
+
+    // Place on the output the pointer is on
+    Window returned_root, returned_child;
+    int root_x, root_y, win_x, win_y;
+    unsigned int returned_mask;
+    TRACE_CALL("XQueryPointer", XQueryPointer(display_, root_, &returned_root, &returned_child, &root_x, &root_y, &win_x, &win_y, &returned_mask));
+    const Rect<int> area = outputs_.OutputAt(root_x, root_y).WorkArea();
+
+    // Look for a spot that doesn't overlap any frame on that output
+    vector<Rect<int>> frame_rects;
+    frame_rects.reserve(clients_.size());
+    for(const auto& client : clients_) {
+        frame_rects.push_back(client.second.OuterRect());
+    }
+
+    Position<int> pos;
+    if(FindFreePosition(area, frame_rects, Size<int>(outer.width, outer.height), pos)) {
+        return pos;
+    }
+
+    // The output is full, cascade instead
+    return CascadePosition(area, Size<int>(outer.width, outer.height), cascade_count_++);
+}
+
+void WindowManager::RequestIcon(Frame& frame) {
+    icons_.Request(frame.client_win, ++frame.icon_generation);
+}
+
+void WindowManager::ApplyIcons() {
+    TRACE_SPAN("ApplyIcons");
+    IconResult *result = icons_.TakeResults();
+    while(result) {
+        // Drop icons for windows that are gone or that have asked for a newer icon since
+        auto it = clients_.find(result->client_win);
+        if(it != clients_.end() && it->second.icon_generation == result->generation) {
+            it->second.SetIcon(display_, root_, result->pixels.data(), result->width, result->height);
+        }
+
+        IconResult *next = result->next;
+        delete result;
+        result = next;
+    }
+}
+
+void WindowManager::OnPropertyNotify(const XPropertyEvent& e) {
+    TRACE_SPAN("OnPropertyNotify");
+    auto it = clients_.find(e.window);
+    if(it == clients_.end()) {
+        return;
+    }
+
+    // Only the icon that changed is fetched again
+    if(e.atom == NET_WM_ICON) {
+        RequestIcon(it->second);
+    }
+
+    // Titles are fetched when they are repainted, so a burst of changes costs one round trip
+    if(e.atom == NET_WM_NAME || e.atom == XA_WM_NAME) {
+        it->second.title_changed = true;
+        it->second.title_dirty = true;
+    }
+}
+
+string WindowManager::FetchTitle(Window w) {
+    TRACE_SPAN("FetchTitle");
+    // UTF-8 _NET_WM_NAME first
+    Atom type;
+    int format;
+    unsigned long num_items, bytes_after;
+    unsigned char *data = nullptr;
+    if(TRACE_CALL("XGetWindowProperty", XGetWindowProperty(display_, w, NET_WM_NAME, 0, 1024, false, UTF8_STRING,
+                &type, &format, &num_items, &bytes_after, &data)) == Success && data) {
+        string title(reinterpret_cast<char*>(data), num_items);
+        XFree(data);
+        if(type == UTF8_STRING && format == 8)
+            return title;
+    }
+
+    // Then the ICCCM WM_NAME, in whatever encoding it uses
+    string title;
+    XTextProperty text_prop;
+    if(TRACE_CALL("XGetWMName", XGetWMName(display_, w, &text_prop)) && text_prop.value) {
+        char **list = nullptr;
+        int count = 0;
+        if(Xutf8TextPropertyToTextList(display_, &text_prop, &list, &count) >= Success && count > 0 && list) {
+            title = list[0];
+            XFreeStringList(list);
+        }
+        XFree(text_prop.value);
+    }
+    return title;
 }
 
+int WindowManager::PaintTitles() {
+    TRACE_SPAN("PaintTitles");
+    if(!title_font_.font) {
+        return -1;
+    }
+
+    const long now = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    long timeout = -1;
+    for(auto& client : clients_) {
+        Frame& frame = client.second;
+        // Fullscreen frames keep the title dirty until they are decorated again
+        if(!frame.title_dirty || frame.fullscreen)
+            continue;
+
+        // Painted too recently, come back when the interval is over
+        long wait = frame.title_painted_at + TITLE_REPAINT_INTERVAL - now;
+        if(wait > 0) {
+            timeout = timeout < 0 ? wait : min(timeout, wait);
+            continue;
+        }
+
+        if(frame.title_changed) {
+            frame.title_changed = false;
+            frame.title = FetchTitle(frame.client_win);
+        }
+
+        if(frame.PaintTitle(display_, root_, title_font_, title_gc_))
+            frame.title_painted_at = now;
+    }
+    return timeout;
+}
+
+void WindowManager::SetFocus(Window w) {
+    XSetInputFocus(display_, w, w == root_ ? RevertToNone : RevertToParent, CurrentTime);
+    if(w == focused_)
+        return;
+    focused_ = w;
+    UpdateInputMode();
+
+    auto it = clients_.find(w);
+    ipc_.Broadcast(MakeIpcEvent(IPC_EVENT_FOCUS, w == root_ ? None : w, it != clients_.end() ? &it->second : nullptr));
+}
+
+void WindowManager::HandleIpc(const vector<IpcMessage>& messages) {
+    TRACE_SPAN("HandleIpc");
+    for(const IpcMessage& message : messages) {
+        switch(message.type) {
+            case IPC_COMMAND:
+                RunIpcCommands(message);
+                break;
+            case IPC_GET_TREE: {
+                vector<IpcWindowInfo> tree;
+                tree.reserve(client_order_.size());
+                for(Window w : client_order_) {
+                    const Frame& frame = clients_[w];
+                    uint32_t flags = (w == focused_ ? uint32_t(IPC_WINDOW_FOCUSED) : 0)
+                        | (frame.maximized ? uint32_t(IPC_WINDOW_MAXIMIZED) : 0)
+                        | (frame.tiled ? uint32_t(IPC_WINDOW_TILED) : 0)
+                        | (frame.fullscreen ? uint32_t(IPC_WINDOW_FULLSCREEN) : 0);
+                    tree.push_back({ uint32_t(w), frame.position.x, frame.position.y, frame.size.width, frame.size.height, flags });
+                }
+                ipc_.Send(message.client, IPC_GET_TREE, tree.data(), tree.size()*sizeof(IpcWindowInfo));
+                break;
+            }
+            case IPC_GET_RESOURCES:
+                SendResources(message.client);
+                break;
+            case IPC_SUBSCRIBE: {
+                uint32_t mask = 0;
+                if(message.payload.size() >= sizeof(mask))
+                    memcpy(&mask, message.payload.data(), sizeof(mask));
+                ipc_.Subscribe(message.client, mask);
+                ipc_.Send(message.client, IPC_SUBSCRIBE, &mask, sizeof(mask));
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+void WindowManager::RunIpcCommands(const IpcMessage& message) {
+    const size_t count = message.payload.size() / sizeof(IpcCommand);
+    vector<int32_t> status(count, 0);
+
+    // Moves and resizes only update the target geometry, which is applied once per frame at the end
+    vector<pair<Frame*, Rect<int>>> geometry;
+    unordered_map<Frame*, size_t> geometry_index;
+
+    for(size_t i = 0; i < count; ++i) {
+        IpcCommand command;
+        memcpy(&command, message.payload.data() + i*sizeof(IpcCommand), sizeof(command));
+
+        auto it = clients_.find(command.window);
+        if(it == clients_.end())
+            continue;
+        Frame& frame = it->second;
+        status[i] = 1;
+
+        switch(command.op) {
+            case IPC_MOVE:
+            case IPC_RESIZE: {
+                auto index = geometry_index.find(&frame);
+                if(index == geometry_index.end()) {
+                    index = geometry_index.emplace(&frame, geometry.size()).first;
+                    geometry.emplace_back(&frame, Rect<int>(frame.position.x, frame.position.y, frame.size.width, frame.size.height));
+                }
+                Rect<int>& target = geometry[index->second].second;
+                if(command.op == IPC_MOVE) {
+                    target.x = command.a;
+                    target.y = command.b;
+                } else {
+                    target.width = max(1, command.a);
+                    target.height = max(CLIENT_OFFSET_Y + 2*BUTTON_PADDING + 1, command.b);
+                }
+                break;
+            }
+            case IPC_FOCUS:
+                SetFocus(frame.client_win);
+                break;
+            case IPC_CLOSE:
+                CloseWindow(frame.client_win);
+                break;
+            case IPC_RAISE:
+                XRaiseWindow(display_, frame.frame_win);
+                break;
+            default:
+                status[i] = 0;
+                break;
+        }
+    }
+
+    for(const auto& g : geometry) {
+        // A fullscreen client covers its output until it leaves fullscreen
+        if(g.first->fullscreen)
+            continue;
+        g.first->MoveResizeFrame(display_, g.second.x, g.second.y, g.second.width, g.second.height);
+    }
+
+    ipc_.Send(message.client, IPC_COMMAND, status.data(), status.size()*sizeof(int32_t));
+}
+
+void WindowManager::SendResources(int client) {
+    // Totals first, then what each frame owns
+    string reply;
+    const ResourceCounts live = LiveResources();
+    IpcResources totals = { 0, int32_t(live.count[RESOURCE_PIXMAP]), int32_t(live.count[RESOURCE_WINDOW]),
+        int32_t(live.count[RESOURCE_CURSOR]), int32_t(live.count[RESOURCE_GC]) };
+    reply.append(reinterpret_cast<const char*>(&totals), sizeof(totals));
+    for(Window w : client_order_) {
+        const ResourceCounts counts = clients_[w].Resources();
+        IpcResources frame = { uint32_t(w), int32_t(counts.count[RESOURCE_PIXMAP]), int32_t(counts.count[RESOURCE_WINDOW]),
+            int32_t(counts.count[RESOURCE_CURSOR]), int32_t(counts.count[RESOURCE_GC]) };
+        reply.append(reinterpret_cast<const char*>(&frame), sizeof(frame));
+    }
+    ipc_.Send(client, IPC_GET_RESOURCES, reply.data(), reply.size());
+}
+
+void WindowManager::BroadcastGeometry() {
+    TRACE_SPAN("BroadcastGeometry");
+    const bool subscribed = ipc_.HasSubscribers(IPC_EVENT_GEOMETRY);
+    for(auto& client : clients_) {
+        Frame& frame = client.second;
+        if(!frame.geometry_changed)
+            continue;
+        frame.geometry_changed = false;
+        if(subscribed)
+            ipc_.Broadcast(MakeIpcEvent(IPC_EVENT_GEOMETRY, client.first, &frame));
+    }
+}
 
 void WindowManager::UnFrame(Window w) {
+    TRACE_SPAN("UnFrame");
     // Reverse steps taken in Frame()
-    const Frame frame = clients_[w];
+    Frame& frame = clients_[w];
+    const Output& output = outputs_.OutputAt(frame.OuterRect());
+
+    // Forget about the frame if it is being dragged or closed
+    if(frame_being_moved_resized == &frame)
+        frame_being_moved_resized = nullptr;
+    if(frame_being_closed == &frame)
+        frame_being_closed = nullptr;
 
     // Unmap frame
     XUnmapWindow(display_, frame.frame_win);
@@ -265,26 +894,110 @@ void WindowManager::UnFrame(Window w) {
     // Remove client window from save set
     XRemoveFromSaveSet(display_, w);
 
-    // Destroy frame
-    XDestroyWindow(display_, frame.frame_win);
-    XDestroyWindow(display_, frame.close_win);
-    XDestroyWindow(display_, frame.max_win);
-    XDestroyWindow(display_, frame.min_win);
+    // The frame windows and pixmaps are freed with the Frame
 
     // Drop reference to frame handle
-    clients_.erase(w);
     frames_.erase(frame.frame_win);
+    clients_.erase(w);
+    client_order_.erase(remove(client_order_.begin(), client_order_.end(), w), client_order_.end());
+
+    // Root input comes back if this was the focused fullscreen client
+    if(focused_ == w) {
+        focused_ = None;
+        UpdateInputMode();
+    }
+
+    // Let the remaining frames fill the gap
+    if(output.layout != Layout::Floating) {
+        Retile(output);
+    }
+
+    ipc_.Broadcast(MakeIpcEvent(IPC_EVENT_UNMAP, w, nullptr));
 
     //TODO: focus on the next client. For now, focus on the root window
-    XSetInputFocus(display_, root_, RevertToNone, CurrentTime);
+    SetFocus(root_);
+
+}
+
+void WindowManager::Retile(const Output& output) {
+    TRACE_SPAN("Retile");
+    // Frames on this output in tiling order. Maximized and fullscreen frames stay on top of the layout
+    vector<Frame*> frames;
+    for(Window w : client_order_) {
+        Frame& frame = clients_[w];
+        if(!frame.maximized && !frame.fullscreen && &outputs_.OutputAt(frame.OuterRect()) == &output) {
+            frames.push_back(&frame);
+        }
+    }
 
-    // If there are no clients left, set the input focus to the root window
-    if(clients_.empty())
-        XSetInputFocus(display_, root_, RevertToNone, CurrentTime);
+    // Going back to floating puts every frame where it was before it was tiled
+    if(output.layout == Layout::Floating) {
+        for(Frame* frame : frames) {
+            if(frame->tiled) {
+                frame->tiled = false;
+                const Rect<int>& r = frame->floating_rect;
+                frame->MoveResizeFrame(display_, r.x, r.y, r.width, r.height);
+            }
+        }
+        return;
+    }
 
+    // Compute the whole arrangement first, then only reconfigure the frames that actually move
+    const vector<Rect<int>> rects = TileLayout(output.layout, output.WorkArea(), frames.size());
+    for(size_t i = 0; i < frames.size(); ++i) {
+        Frame& frame = *frames[i];
+        if(!frame.tiled) {
+            frame.floating_rect = Rect<int>(frame.position.x, frame.position.y, frame.size.width, frame.size.height);
+            frame.tiled = true;
+        }
+        frame.MoveResizeFrame(display_, rects[i].x, rects[i].y, rects[i].width - 2*FRAME_BORDER_WIDTH, rects[i].height - 2*FRAME_BORDER_WIDTH);
+    }
+}
+
+void WindowManager::RenderWallpaper() {
+    TRACE_SPAN("RenderWallpaper");
+    vector<Rect<int>> rects;
+    for(const Output& output : outputs_.outputs) {
+        rects.push_back(output.rect);
+    }
+    wallpaper_.Render(display_, root_, rects);
+}
+
+void WindowManager::RelocateFrames(const vector<Rect<int>>& changed) {
+    TRACE_SPAN("RelocateFrames");
+    for(auto& client : clients_) {
+        Frame& frame = client.second;
+        const Rect<int> outer = frame.OuterRect();
+        const Position<int> center(outer.x + outer.width/2, outer.y + outer.height/2);
+
+        // Only frames on an output that changed are touched
+        if(none_of(changed.begin(), changed.end(), [&center](const Rect<int>& r) { return r.Contains(center.x, center.y); }))
+            continue;
+
+        if(frame.fullscreen) {
+            frame.EnterFullscreen(display_, outputs_.OutputAt(center.x, center.y).rect);
+        } else if(frame.maximized) {
+            frame.Maximize(display_, outputs_.OutputAt(center.x, center.y).WorkArea());
+        } else {
+            const Position<int> pos = outputs_.Clamp(outer);
+            if(pos.x != outer.x || pos.y != outer.y)
+                frame.MoveFrame(display_, pos.x, pos.y);
+        }
+    }
+
+    // Tiled outputs that changed size are laid out again
+    for(const Output& output : outputs_.outputs) {
+        if(output.layout != Layout::Floating && find(changed.begin(), changed.end(), output.rect) != changed.end()) {
+            Retile(output);
+        }
+    }
 }
 
 void WindowManager::OnMotionNotify(const XMotionEvent& e) {
+    TRACE_SPAN("OnMotionNotify");
+
+    if(start_menu_.open)
+        start_menu_.Hover(display_, e.x_root, e.y_root);
 
     const Position<int> drag_pos(e.x_root, e.y_root);
     const Vector2D<int> delta(drag_pos.x - drag_start_pos.x, drag_pos.y - drag_start_pos.y);
@@ -295,63 +1008,68 @@ void WindowManager::OnMotionNotify(const XMotionEvent& e) {
     const Size<int> dest_frame_size(drag_start_frame_size.width + delta.x, drag_start_frame_size.height + delta.y);
 
     // Move/resize the frame that is to be moved/resize if the left button is pressed
-    if((e.state & Button1Mask)) {
+    if((e.state & Button1Mask) && frame_being_moved_resized) {
         //
         // Resize, else move
         if(top || bottom || left || right){
-            Window returned_root;
-            int original_x, original_y;
-            unsigned original_width, original_height, border_width, depth;
-            XGetGeometry(display_, frame_being_moved_resized.frame_win, &returned_root, &original_x, &original_y,
-                    &original_width, &original_height, &border_width, &depth);
+            const int original_x = frame_being_moved_resized->position.x;
+            const int original_y = frame_being_moved_resized->position.y;
+            const int original_width = frame_being_moved_resized->size.width;
+            const int original_height = frame_being_moved_resized->size.height;
 
             if(top && left) {
-                frame_being_moved_resized.ResizeFrame(display_, dest_frame_size.width-2*delta.x, dest_frame_size.height-2*delta.y);
-                frame_being_moved_resized.MoveFrame(display_, e.x_root, e.y_root);//TODO: Dont just warp to mouse
+                frame_being_moved_resized->ResizeFrame(display_, dest_frame_size.width-2*delta.x, dest_frame_size.height-2*delta.y);
+                frame_being_moved_resized->MoveFrame(display_, e.x_root, e.y_root);//TODO: Dont just warp to mouse
             } else if(top && right) {
-                frame_being_moved_resized.ResizeFrame(display_, dest_frame_size.width, dest_frame_size.height-2*delta.y);
-                frame_being_moved_resized.MoveFrame(display_, original_x, e.y_root);//TODO: Dont just warp to mouse
+                frame_being_moved_resized->ResizeFrame(display_, dest_frame_size.width, dest_frame_size.height-2*delta.y);
+                frame_being_moved_resized->MoveFrame(display_, original_x, e.y_root);//TODO: Dont just warp to mouse
             } else if(bottom && left){
-                frame_being_moved_resized.ResizeFrame(display_, dest_frame_size.width-2*delta.x, dest_frame_size.height);
-                frame_being_moved_resized.MoveFrame(display_, e.x_root, original_y);
+                frame_being_moved_resized->ResizeFrame(display_, dest_frame_size.width-2*delta.x, dest_frame_size.height);
+                frame_being_moved_resized->MoveFrame(display_, e.x_root, original_y);
             } else if(bottom && right) {
                 //if(width < 1) { width = 1; }
                 //if(height < CLIENT_OFFSET_Y+2*BUTTON_PADDING) { height = CLIENT_OFFSET_Y + 2*BUTTON_PADDING; }
-                frame_being_moved_resized.ResizeFrame(display_, dest_frame_size.width, dest_frame_size.height);
+                frame_being_moved_resized->ResizeFrame(display_, dest_frame_size.width, dest_frame_size.height);
             } else if(top) {
-                frame_being_moved_resized.ResizeFrame(display_, original_width, dest_frame_size.height-2*delta.y);
-                frame_being_moved_resized.MoveFrame(display_, original_x, e.y_root);//TODO: Dont just warp to mouse
+                frame_being_moved_resized->ResizeFrame(display_, original_width, dest_frame_size.height-2*delta.y);
+                frame_being_moved_resized->MoveFrame(display_, original_x, e.y_root);//TODO: Dont just warp to mouse
 
             } else if(bottom) {
                 //if(height < CLIENT_OFFSET_Y+2*BUTTON_PADDING) { height = CLIENT_OFFSET_Y + 2*BUTTON_PADDING; }
-                frame_being_moved_resized.ResizeFrame(display_, original_width, dest_frame_size.height);
+                frame_being_moved_resized->ResizeFrame(display_, original_width, dest_frame_size.height);
             } else if(left) {
-                frame_being_moved_resized.ResizeFrame(display_, dest_frame_size.width-2*delta.x, original_height);
-                frame_being_moved_resized.MoveFrame(display_, e.x_root, original_y);
+                frame_being_moved_resized->ResizeFrame(display_, dest_frame_size.width-2*delta.x, original_height);
+                frame_being_moved_resized->MoveFrame(display_, e.x_root, original_y);
             } else if(right) {
-                frame_being_moved_resized.ResizeFrame(display_, dest_frame_size.width, original_height);
+                frame_being_moved_resized->ResizeFrame(display_, dest_frame_size.width, original_height);
             } else {
                 return;
             }
 
         } else {
-            frame_being_moved_resized.MoveFrame(display_, dest_frame_pos.x, dest_frame_pos.y);
+            // Snap to the nearest frame or output edge
+            const Rect<int> outer = frame_being_moved_resized->OuterRect();
+            const Position<int> snapped = snap_edges_.Snap(Rect<int>(dest_frame_pos.x, dest_frame_pos.y, outer.width, outer.height));
+            frame_being_moved_resized->MoveFrame(display_, snapped.x, snapped.y);
         }
     }
 }
 
 void WindowManager::UpdateCursor(const XEvent& ev){
+    TRACE_SPAN("UpdateCursor");
 
     const XMotionEvent e = ev.xmotion;
 
-    Frame frame = frames_[e.subwindow];
+    // Only frames can be resized, anything else (e.g. a bar) gets the default cursor
+    auto frame_it = frames_.find(e.subwindow);
 
-    Window returned_root_frame;
-    int x_frame, y_frame;
-    unsigned width_frame, height_frame, border_width_frame, depth_frame;
-    XGetGeometry(display_, frame.frame_win, &returned_root_frame, &x_frame, &y_frame, &width_frame, &height_frame, &border_width_frame, &depth_frame);
+    if(!button_pressed && frame_it != frames_.end()) {
+        const Frame& frame = *frame_it->second;
+        const int x_frame = frame.position.x;
+        const int y_frame = frame.position.y;
+        const int width_frame = frame.size.width;
+        const int height_frame = frame.size.height;
 
-    if(!button_pressed && e.subwindow != None) {
         left = right = top = bottom = false;
         if(e.x < x_frame+EDGE_GRAB_DISTANCE)
             left = true;
@@ -384,7 +1102,7 @@ void WindowManager::UpdateCursor(const XEvent& ev){
             XDefineCursor(display_, root_, right_cursor);
         else
             XDefineCursor(display_, root_, default_cursor);
-    } else if (!button_pressed && e.subwindow == None){
+    } else if (!button_pressed){
         left = right = top = bottom = false;
         XDefineCursor(display_, root_, default_cursor);
     }
@@ -395,26 +1113,41 @@ bool WindowManager::InsideWindow(Window win){
     Window root, child;
     int root_x, root_y, child_x, child_y;
     unsigned int returned_mask;
-    XQueryPointer(display_, win, &root, &child, &root_x, &root_y, &child_x, &child_y, &returned_mask);
+    TRACE_CALL("XQueryPointer", XQueryPointer(display_, win, &root, &child, &root_x, &root_y, &child_x, &child_y, &returned_mask));
 
     Window returned_root;
     int x, y;
     unsigned width, height, border_width, depth;
-    XGetGeometry(display_, win, &returned_root, &x, &y, &width, &height, &border_width, &depth);
+    TRACE_CALL("XGetGeometry", XGetGeometry(display_, win, &returned_root, &x, &y, &width, &height, &border_width, &depth));
 
     return child_x > 0 && child_x < width && child_y > 0 && child_y < height;
 
 }
 
 void WindowManager::OnButtonPress(const XButtonEvent& e){
+    TRACE_SPAN("OnButtonPress");
 
     button_pressed = true;
 
-    bool frame_button_pressed;
+    bool frame_button_pressed = false;
+
+    // The start button toggles the start menu, a click on an item runs it and a click anywhere else closes it
+    if(start_menu_.open && e.subwindow == start_menu_.menu_win) {
+        start_menu_.Click(e.x_root, e.y_root);
+        CloseStartMenu();
+        return;
+    }
+    if(Output* output = outputs_.FindBar(e.subwindow)) {
+        if(InsideWindow(output->bar.start_button)) {
+            ToggleStartMenu(*output);
+            return;
+        }
+    }
+    CloseStartMenu();
 
     // TODO: Right click on root will open a menu
     if(e.subwindow == None) {
-        XSetInputFocus(display_, root_, RevertToNone, CurrentTime);
+        SetFocus(root_);
         return;
     }
 
@@ -422,11 +1155,15 @@ void WindowManager::OnButtonPress(const XButtonEvent& e){
     XRaiseWindow(display_, e.subwindow);
 
     // Get the frame that was clicked
-    Frame frame = frames_[e.subwindow];
+    auto frame_it = frames_.find(e.subwindow);
+    if(frame_it == frames_.end()) {
+        return;
+    }
+    Frame& frame = *frame_it->second;
 
     // Keep the client window focused
     // Revert to root if no subwindow is clicked, this way key combos still work
-    XSetInputFocus(display_, frame.client_win, RevertToParent, CurrentTime);
+    SetFocus(frame.client_win);
 
     // Return if the click was inside the client window
     if(InsideWindow(frame.client_win)){
@@ -436,12 +1173,18 @@ void WindowManager::OnButtonPress(const XButtonEvent& e){
 
     if(InsideWindow(frame.close_win)){
         printf("Close win\n");
-        frame_being_closed = frame;
+        frame_being_closed = &frame;
         frame_button_pressed = true;
     }
 
     if(InsideWindow(frame.max_win)){
         printf("Max win\n");
+        // Maximize to the work area of the output the frame is on
+        if(frame.maximized) {
+            frame.Restore(display_);
+        } else {
+            frame.Maximize(display_, outputs_.OutputAt(frame.OuterRect()).WorkArea());
+        }
         frame_button_pressed = true;
     }
 
@@ -451,31 +1194,161 @@ void WindowManager::OnButtonPress(const XButtonEvent& e){
     }
 
     // If the window clicked is a frame, prepare to move or resize it
-    if(frames_.count(e.subwindow) & !frame_button_pressed){
-
-        // Handle clicks of frame buttons
-        Window returned_root_frame;
-        int x_frame, y_frame;
-        unsigned width_frame, height_frame, border_width_frame, depth_frame;
-        XGetGeometry(display_, frame.frame_win, &returned_root_frame, &x_frame, &y_frame, &width_frame, &height_frame, &border_width_frame, &depth_frame);
+    if(!frame_button_pressed){
 
         // Save intial cursor position
         drag_start_pos = Position<int>(e.x_root, e.y_root);
 
-        drag_start_frame_pos = Position<int>(x_frame, y_frame);
-        drag_start_frame_size = Size<int>(width_frame, height_frame);
+        drag_start_frame_pos = frame.position;
+        drag_start_frame_size = frame.size;
 
         // Set the frame to the frame that is being moved or resized
-        frame_being_moved_resized = frame;
+        frame_being_moved_resized = &frame;
+
+        // Collect the edges to snap to once for the whole drag
+        vector<Rect<int>> frame_rects, areas;
+        frame_rects.reserve(clients_.size());
+        for(const auto& client : clients_) {
+            if(&client.second != &frame)
+                frame_rects.push_back(client.second.OuterRect());
+        }
+        for(const Output& output : outputs_.outputs) {
+            areas.push_back(output.WorkArea());
+        }
+        snap_edges_.Build(frame_rects, areas);
+    }
+}
+
+void WindowManager::ToggleStartMenu(Output& output) {
+    if(start_menu_.open) {
+        CloseStartMenu();
+        return;
+    }
+    start_menu_.Open(display_, root_, title_font_, output.rect);
+    output.bar.SetPressed(display_, true);
+}
+
+void WindowManager::CloseStartMenu() {
+    if(!start_menu_.open)
+        return;
+    start_menu_.Close(display_);
+    for(Output& output : outputs_.outputs) {
+        output.bar.SetPressed(display_, false);
+    }
+}
+
+void WindowManager::OnClientMessage(const XClientMessageEvent& e) {
+    TRACE_SPAN("OnClientMessage");
+    auto it = clients_.find(e.window);
+    if(it == clients_.end() || e.message_type != NET_WM_STATE || e.format != 32)
+        return;
+
+    // One message can change two states, only fullscreen is handled
+    Frame& frame = it->second;
+    if(Atom(e.data.l[1]) != NET_WM_STATE_FULLSCREEN && Atom(e.data.l[2]) != NET_WM_STATE_FULLSCREEN)
+        return;
+    switch(e.data.l[0]) {
+        case NET_WM_STATE_REMOVE:
+            SetFullscreen(frame, false);
+            break;
+        case NET_WM_STATE_ADD:
+            SetFullscreen(frame, true);
+            break;
+        case NET_WM_STATE_TOGGLE:
+            SetFullscreen(frame, !frame.fullscreen);
+            break;
+    }
+}
+
+bool WindowManager::WantsFullscreen(Window w) {
+    const vector<Atom> states = GetWindowState(w);
+    return find(states.begin(), states.end(), NET_WM_STATE_FULLSCREEN) != states.end();
+}
+
+vector<Atom> WindowManager::GetWindowState(Window w) {
+    Atom type;
+    int format;
+    unsigned long count, bytes_after;
+    unsigned char *data = nullptr;
+    vector<Atom> states;
+    if(TRACE_CALL("XGetWindowProperty", XGetWindowProperty(display_, w, NET_WM_STATE, 0, 64, false, XA_ATOM,
+                &type, &format, &count, &bytes_after, &data)) == Success && data) {
+        if(type == XA_ATOM && format == 32) {
+            const Atom *atoms = reinterpret_cast<const Atom*>(data);
+            states.assign(atoms, atoms + count);
+        }
+        XFree(data);
+    }
+    return states;
+}
+
+void WindowManager::SetFullscreen(Frame& frame, bool fullscreen) {
+    TRACE_SPAN("SetFullscreen");
+    if(!fullscreen && !frame.fullscreen) {
+        UpdateInputMode();
+        return;
+    }
+
+    if(fullscreen) {
+        // Don't leave a drag pointing at a frame the user can no longer see
+        if(frame_being_moved_resized == &frame)
+            frame_being_moved_resized = nullptr;
+        frame.EnterFullscreen(display_, outputs_.OutputAt(frame.OuterRect()).rect);
+        XRaiseWindow(display_, frame.frame_win);
+    } else {
+        frame.LeaveFullscreen(display_);
+    }
+
+    // Only add or remove the fullscreen state, the client's other states stay as they are
+    vector<Atom> states = GetWindowState(frame.client_win);
+    states.erase(remove(states.begin(), states.end(), NET_WM_STATE_FULLSCREEN), states.end());
+    if(fullscreen)
+        states.push_back(NET_WM_STATE_FULLSCREEN);
+    XChangeProperty(display_, frame.client_win, NET_WM_STATE, XA_ATOM, 32, PropModeReplace,
+            reinterpret_cast<unsigned char*>(states.data()), states.size());
+    UpdateInputMode();
+}
+
+void WindowManager::UpdateInputMode() {
+    // Only while the pointer is over the focused fullscreen client. The other outputs keep click to focus and dragging,
+    // and the frame's crossing events switch back as soon as the pointer leaves its output
+    auto it = clients_.find(focused_);
+    bool suspend = false;
+    if(it != clients_.end() && it->second.fullscreen) {
+        Window root, child;
+        int root_x, root_y, win_x, win_y;
+        unsigned int mask;
+        TRACE_CALL("XQueryPointer", XQueryPointer(display_, root_, &root, &child, &root_x, &root_y, &win_x, &win_y, &mask));
+        suspend = child == it->second.frame_win;
+    }
+    if(suspend == input_suspended_)
+        return;
+    input_suspended_ = suspend;
+
+    if(suspend) {
+        XUngrabButton(display_, Button1, AnyModifier, root_);
+        XSelectInput(display_, root_, ROOT_EVENT_MASK);
+        XDefineCursor(display_, root_, default_cursor);
+    } else {
+        XSelectInput(display_, root_, ROOT_EVENT_MASK | ROOT_MOTION_MASK);
+        XGrabButton(display_, Button1, AnyModifier, root_, false, Button1Mask, GrabModeSync, GrabModeAsync, None, None);
     }
 }
 
 void WindowManager::OnKeyPress(const XKeyEvent& e){
+    TRACE_SPAN("OnKeyPress");
 
     // If Alt-R is pressed, run dmenu
     if ((e.state & Mod1Mask) && (e.keycode == XKeysymToKeycode(display_, XK_r))) {
         system("dmenu_run -c -l 30 -bw 3 &");
     }
+
+    // If Alt-T is pressed, switch the output under the pointer to the next layout
+    if ((e.state & Mod1Mask) && (e.keycode == XKeysymToKeycode(display_, XK_t))) {
+        Output& output = outputs_.OutputAt(e.x_root, e.y_root);
+        output.layout = NextLayout(output.layout);
+        Retile(output);
+    }
 }
 
 void WindowManager::CloseWindow(Window win_to_close){
@@ -489,7 +1362,7 @@ void WindowManager::CloseWindow(Window win_to_close){
 bool WindowManager::SendMessage(Window win, Atom protocol){
     Atom *supported_protocols;
     int num_supported_protocols;
-    if(XGetWMProtocols(display_, win, &supported_protocols, &num_supported_protocols) &&
+    if(TRACE_CALL("XGetWMProtocols", XGetWMProtocols(display_, win, &supported_protocols, &num_supported_protocols)) &&
             (std::find(supported_protocols, supported_protocols + num_supported_protocols, protocol) != supported_protocols + num_supported_protocols)){
         XEvent msg;
         memset(&msg, 0, sizeof(msg));
@@ -506,14 +1379,16 @@ bool WindowManager::SendMessage(Window win, Atom protocol){
 }
 
 void WindowManager::OnButtonRelease(const XButtonEvent& e){
+    TRACE_SPAN("OnButtonRelease");
     button_pressed = false;
-    frame_being_moved_resized = {};
+    frame_being_moved_resized = nullptr;
+    snap_edges_.Clear();
 
     // Close the frame_being_closed if the pointer is still in the close button on release
-    if(InsideWindow(frame_being_closed.close_win)){
-        CloseWindow(frame_being_closed.client_win);
-        frame_being_closed = {};
+    if(frame_being_closed && InsideWindow(frame_being_closed->close_win)){
+        CloseWindow(frame_being_closed->client_win);
     }
+    frame_being_closed = nullptr;
 
 }
 
@@ -524,6 +1399,12 @@ void WindowManager::OnReparentNotify(const XReparentEvent& e){}
 
 void WindowManager::OnMapNotify(const XMapEvent& e){}
 
-void WindowManager::OnDestroyNotify(const XDestroyWindowEvent& e){}
+void WindowManager::OnDestroyNotify(const XDestroyWindowEvent& e){
+    TRACE_SPAN("OnDestroyNotify");
+    // A client destroyed without being unmapped first would otherwise keep its frame forever
+    if(clients_.count(e.window)) {
+        UnFrame(e.window);
+    }
+}
 
 void WindowManager::OnConfigureNotify(const XConfigureEvent& e){}
@@ -5,10 +5,19 @@ extern "C" {
 #include <X11/Xlib.h>
 }
 #include <memory>
+#include <string>
 #include <unordered_map>
 #include "util.hpp"
 #include "frame.hpp"
 #include "bar.hpp"
+#include "output.hpp"
+#include "snap.hpp"
+#include "icon.hpp"
+#include "font.hpp"
+#include "ipc.hpp"
+#include "resource.hpp"
+#include "wallpaper.hpp"
+#include "start_menu.hpp"
 
 #define XC_top_left_corner 134
 #define XC_top_right_corner 136
@@ -22,6 +31,19 @@ extern "C" {
 
 #define EDGE_GRAB_DISTANCE FRAME_BORDER_WIDTH+2
 
+// Minimum time between two repaints of the same title, in milliseconds
+#define TITLE_REPAINT_INTERVAL 16
+
+// Events selected on the root. The motion part is dropped while a fullscreen client has the focus
+#define ROOT_EVENT_MASK (SubstructureRedirectMask | SubstructureNotifyMask | ButtonPressMask | ButtonReleaseMask \
+        | KeyPressMask | KeyReleaseMask)
+#define ROOT_MOTION_MASK (ButtonMotionMask | PointerMotionMask)
+
+// Actions of a _NET_WM_STATE client message
+#define NET_WM_STATE_REMOVE 0
+#define NET_WM_STATE_ADD 1
+#define NET_WM_STATE_TOGGLE 2
+
 class WindowManager {
     public:
         // Establish connection to X server and create WindowManager instance
@@ -33,13 +55,14 @@ class WindowManager {
         // Start WM
         void Start();
 
-        Bar bar;
-
     private:
 
         // Main event loop
         void Run();
 
+        // Handles one event
+        void Dispatch(XEvent& e);
+
         // Setup
         void Setup();
 
@@ -52,15 +75,42 @@ class WindowManager {
         // Handle to root window
         const Window root_;
 
-        // Maps top-level windows to their Frames
+        // Maps top-level windows to their Frames. Owns the Frame objects
         ::std::unordered_map<Window, Frame> clients_;
 
-        // Maps frame_win's to their Frame objects
-        ::std::unordered_map<Window, Frame> frames_;
+        // Maps frame_win's to their Frame objects in clients_
+        ::std::unordered_map<Window, Frame*> frames_;
+
+        // Top-level windows in the order they were framed, used as the tiling order
+        ::std::vector<Window> client_order_;
+
+        // Monitors and their bars
+        OutputTable outputs_;
+
+        // Root window background, set from LINUXXP_WALLPAPER
+        Wallpaper wallpaper_;
+
+        // Applications menu of the start button
+        StartMenu start_menu_;
+
+        // Open the start menu above the start button of output, or close it if it is open
+        void ToggleStartMenu(Output& output);
+        void CloseStartMenu();
 
         // Xlib error handler. Must be static because its address is passed to Xlib
         static int OnXError(Display* display, XErrorEvent* e);
 
+        // Signal handler for SIGTERM, SIGINT and SIGUSR2. Writes the signal number to signal_pipe_,
+        // which the main loop polls. Must be static because its address is passed to sigaction
+        static void OnSignal(int signo);
+        static int signal_pipe_[2];
+
+        // Act on the signals received since the last call: export the trace on SIGUSR2, stop otherwise
+        void HandleSignals();
+
+        // Cleared to leave the main loop
+        bool running_ = true;
+
         // Xlib error handler to determine if another window manager is already running
         static int OnWMDetected(Display* display, XErrorEvent* e);
 
@@ -77,10 +127,29 @@ class WindowManager {
         Size<int> drag_start_frame_size;
 
         // Frame that is being moved or resized
-        Frame frame_being_moved_resized;
+        Frame* frame_being_moved_resized = nullptr;
+
+        // Loads application icons off the event loop
+        IconLoader icons_;
+
+        // Control socket
+        IpcServer ipc_;
+
+        // Client that has the input focus, root_ if none
+        Window focused_ = None;
+
+        // Font and background GC for the titles
+        GlyphCache title_font_;
+        OwnedGC title_gc_;
+
+        // Button images shared by all frames
+        FrameTheme frame_theme_;
+
+        // Edges the frame being moved snaps to
+        SnapEdges snap_edges_;
 
         // Frame that is about to be closed
-        Frame frame_being_closed;
+        Frame* frame_being_closed = nullptr;
 
         // Button being pressed
         bool button_pressed;
@@ -105,13 +174,90 @@ class WindowManager {
         void OnMotionNotify(const XMotionEvent& e);
         void OnKeyPress(const XKeyEvent& e);
         void OnKeyRelease(const XKeyEvent& e);
+        void OnPropertyNotify(const XPropertyEvent& e);
+        void OnClientMessage(const XClientMessageEvent& e);
+
+        // Make a client fullscreen on its output, or put it back in its frame
+        void SetFullscreen(Frame& frame, bool fullscreen);
+
+        // Whether the client asks to start fullscreen through _NET_WM_STATE
+        bool WantsFullscreen(Window w);
+
+        // Atoms in a client's _NET_WM_STATE
+        ::std::vector<Atom> GetWindowState(Window w);
+
+        // Stop the synchronous root button grab and the motion tracking while a fullscreen client
+        // has the focus and the pointer is on its output, so its input goes straight to it, and resume them otherwise
+        void UpdateInputMode();
+
+        // Whether the root button grab and motion events are currently suspended
+        bool input_suspended_ = false;
+
+        // Child window for _NET_SUPPORTING_WM_CHECK, which tells clients an EWMH WM is running
+        OwnedWindow wm_check_win_;
 
         // Frames a top-level window
         void FrameWindow(Window w, bool was_created_before_wm);
 
+        // Chooses the position of a new frame for w
+        Position<int> PlaceFrame(Window w, const XWindowAttributes& attrs);
+
+        // Number of frames placed by cascading so far
+        int cascade_count_ = 0;
+
+        // Asks the icon workers for the current icon of a frame's client
+        void RequestIcon(Frame& frame);
+
+        // Puts the icons the workers have finished into their titlebars
+        void ApplyIcons();
+
+        // Reads the title of a client, preferring _NET_WM_NAME
+        ::std::string FetchTitle(Window w);
+
+        // Repaints titles that changed, at most once per TITLE_REPAINT_INTERVAL per frame.
+        // Returns the time in milliseconds until a deferred repaint is due, -1 if there is none
+        int PaintTitles();
+
+        // Gives the input focus to a client, or to the root window
+        void SetFocus(Window w);
+
+        // Executes the requests received on the control socket
+        void HandleIpc(const ::std::vector<IpcMessage>& messages);
+
+        // Applies a batch of commands, each frame is reconfigured at most once
+        void RunIpcCommands(const IpcMessage& message);
+
+        // Reports frames whose geometry changed to the IPC subscribers
+        void BroadcastGeometry();
+
+        // ConfigureRequests of the current dispatch batch, merged per window, in the order they first arrived
+        ::std::vector<XConfigureRequestEvent> configure_requests_;
+        ::std::unordered_map<Window, size_t> configure_index_;
+
+        // Apply the merged ConfigureRequests, once per window
+        void ApplyConfigureRequests();
+
+        // Grant a ConfigureRequest of a managed client by moving and resizing its frame around it
+        void ConfigureFrame(Frame& frame, const XConfigureRequestEvent& e);
+
+        // Tell a client where its window is, for requests that didn't resize it (ICCCM 4.1.5)
+        void SendConfigureNotify(const Frame& frame);
+
+        // Replies with the live resource counts, in total and per frame
+        void SendResources(int client);
+
         // Unframes a top-level window
         void UnFrame(Window w);
 
+        // Arranges the frames on output according to its layout
+        void Retile(const Output& output);
+
+        // Moves the frames that were on outputs whose geometry changed back onto an output
+        void RelocateFrames(const ::std::vector<Rect<int>>& changed);
+
+        // Paint the wallpaper for the current outputs, if there is one
+        void RenderWallpaper();
+
         // Closes a window(client)
         void CloseWindow(Window win_to_close);
 
@@ -128,17 +274,24 @@ class WindowManager {
         // Atoms
         const Atom WM_PROTOCOLS;
         const Atom WM_DELETE_WINDOW;
+        const Atom NET_WM_ICON;
+        const Atom NET_WM_NAME;
+        const Atom UTF8_STRING;
+        const Atom NET_SUPPORTED;
+        const Atom NET_SUPPORTING_WM_CHECK;
+        const Atom NET_WM_STATE;
+        const Atom NET_WM_STATE_FULLSCREEN;
 
         // Cursors
-        Cursor default_cursor;
-        Cursor top_left_cursor;
-        Cursor top_right_cursor;
-        Cursor bottom_left_cursor;
-        Cursor bottom_right_cursor;
-        Cursor top_cursor;
-        Cursor bottom_cursor;
-        Cursor left_cursor;
-        Cursor right_cursor;
+        OwnedCursor default_cursor;
+        OwnedCursor top_left_cursor;
+        OwnedCursor top_right_cursor;
+        OwnedCursor bottom_left_cursor;
+        OwnedCursor bottom_right_cursor;
+        OwnedCursor top_cursor;
+        OwnedCursor bottom_cursor;
+        OwnedCursor left_cursor;
+        OwnedCursor right_cursor;
 
 };
 